@@ -0,0 +1,11 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*
+	Axis aligned bounding box, in mesh local space for meshes and in world space for the scene
+*/
+struct AABB {
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
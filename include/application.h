@@ -2,6 +2,7 @@
 
 #include "renderer.h"
 #include "camera.h"
+#include <chrono>
 
 
 class Application
@@ -26,16 +27,20 @@ private:
 	float m_deltaTime = 0.0f;
 	float m_lastFrame = 0.0f;
 	float m_currentFrame = 0.0f;
+	double m_startupMs = 0.0; // Until the first frame, which waits for the programs it binds
+	std::chrono::steady_clock::time_point m_startTime;
 
 	std::shared_ptr<Shader> m_basicShader;
 
 	std::unordered_map<MeshType, std::shared_ptr<Mesh>> m_meshes;
 
 	std::unordered_map<std::string, std::shared_ptr<Material>> m_materials;
+	std::unordered_map<std::string, MaterialId> m_materialIds; // The same materials registered in the scene
 
 	
 	std::vector<const char*> m_meshTypes;
 	int m_meshTypeIndex = 0;
+	std::vector<const char*> m_iblQualities;
 
 	void initUI();
 	void updateUI();
@@ -43,6 +48,7 @@ private:
 	void setCallbacks();
 
 	void deltaTime();
+	void printStartupReport();
 
 	void setupImGuiStyle();
 };
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+	Split-sum BRDF integration table: scale and bias applied to F0 as a function of NdotV (x)
+	and roughness (y). It does not depend on the environment, so it is baked offline by
+	tools/bake_brdf_lut.cpp into an RG16F asset and shared by every Skybox.
+*/
+class BrdfLut
+{
+public:
+	static const int DEFAULT_SIZE = 256;
+	static const int DEFAULT_SAMPLE_COUNT = 4096;
+	// Used when the asset is missing, the integration then runs at startup
+	static const int FALLBACK_SAMPLE_COUNT = 1024;
+
+	// CPU reference of the integration, rows go from roughness 0 to 1 like the texture.
+	// Returns size * size interleaved RG pairs, rows are split across threads.
+	static std::vector<float> compute(int size, int sampleCount);
+	// Value at the center of one texel, exposed to check the table against
+	static void integrate(float NdotV, float roughness, int sampleCount, float& scale, float& bias);
+
+	// Asset file: header then size * size RG half floats
+	static bool write(const std::string& path, int size, int sampleCount, const std::vector<float>& table);
+	static bool read(const std::string& path, int& size, std::vector<uint16_t>& halves);
+
+	// Shared RG16F texture, loaded from the asset on first use. Computed on the CPU when the asset is missing.
+	static unsigned int getTexture();
+};
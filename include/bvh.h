@@ -0,0 +1,70 @@
+#pragma once
+
+#include "aabb.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class Frustum;
+
+/*
+	Dynamic bounding volume hierarchy over boxes, one item per leaf.
+	Built top down with a binned surface area heuristic, then kept up to date with incremental
+	inserts, removals and refits. Leaves keep their node index for their whole life, it is the
+	proxy callers use to move or remove an item.
+*/
+class Bvh
+{
+public:
+	static const int32_t NULL_NODE = -1;
+
+	// Replace the tree with a SAH build, proxies[i] receives the leaf of items[i]
+	void build(const std::vector<AABB>& boxes, const std::vector<uint32_t>& items, std::vector<int32_t>& proxies);
+	void clear();
+
+	// Walk down the branch that grows the least and pair the new leaf with the node found there
+	int32_t insert(const AABB& box, uint32_t item);
+	void remove(int32_t proxy);
+	// Move a leaf and refit its ancestors
+	void update(int32_t proxy, const AABB& box);
+	// Move a leaf without touching its ancestors, call refit once after a batch of these.
+	// Distinct leaves can be moved from several threads at once.
+	void setLeafBounds(int32_t proxy, const AABB& box);
+	// Bottom up over the whole tree, large trees are split into subtrees refit on the job system
+	void refit();
+
+	// Items whose box may intersect the frustum, subtrees fully inside are taken without testing their leaves
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const;
+	void queryBox(const AABB& box, std::vector<uint32_t>& items) const;
+	// Item whose box the ray enters first within maxDistance, false when it hits none.
+	// The direction does not need to be normalized, distance is in units of its length.
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& item, float& distance) const;
+
+	// Surface area of the internal nodes relative to the root, grows as refits degrade the tree
+	float getCost() const;
+	int getHeight() const;
+	size_t getLeafCount() const { return m_leafCount; }
+	bool isEmpty() const { return m_root == NULL_NODE; }
+
+private:
+	struct Node {
+		AABB bounds;
+		int32_t parent = NULL_NODE;
+		int32_t left = NULL_NODE; // NULL_NODE for leaves
+		int32_t right = NULL_NODE;
+		uint32_t item = 0;
+
+		bool isLeaf() const { return left == NULL_NODE; }
+	};
+
+	int32_t allocateNode();
+	void freeNode(int32_t index);
+	void refitAncestors(int32_t index);
+	void refitSubtree(int32_t root);
+	void collectLeaves(int32_t index, std::vector<uint32_t>& items, std::vector<int32_t>& stack) const;
+
+	std::vector<Node> m_nodes;
+	std::vector<int32_t> m_freeNodes;
+	int32_t m_root = NULL_NODE;
+	size_t m_leafCount = 0;
+};
@@ -2,7 +2,7 @@
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
-#include <entity.h>
+#include <scene.h>
 
 class Camera
 {
@@ -16,8 +16,8 @@ public:
 	void setDistance(float distance);
 
 	glm::mat4 getViewMatrix() const { 
-		if (m_target) {
-			return glm::lookAt(m_position, m_target->position, m_up);
+		if (hasTarget()) {
+			return glm::lookAt(m_position, m_targetScene->getPosition(m_target), m_up);
 		}
 		else {
 			return glm::lookAt(m_position, m_position + m_forward, m_up);
@@ -36,11 +36,13 @@ public:
 	float getFov() const { return m_fov; }
 	float getDistance() const { return m_distance; }
 
-	std::shared_ptr<Entity> getTarget() { return m_target; }
-	bool hasTarget() { return m_target != nullptr; }
+	EntityHandle getTarget() const { return m_target; }
+	// False once the target has been destroyed
+	bool hasTarget() const { return m_targetScene && m_targetScene->isAlive(m_target); }
 
 	void setPosition(glm::vec3 position);
-	void setTarget(std::shared_ptr<Entity> target);
+	// Orbit around an entity of the scene, an empty handle goes back to free flight
+	void setTarget(const Scene* scene, EntityHandle target);
 
 	void updateCameraVectors();
 
@@ -69,7 +71,8 @@ private:
 	glm::vec3 m_right;
 	glm::vec3 m_worldUp;
 
-	std::shared_ptr<Entity> m_target;
+	const Scene* m_targetScene = nullptr;
+	EntityHandle m_target;
 	float m_distance = 10.0f;
 
 	float m_yaw;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "uniform_id.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+	Single stage compute program, compiled synchronously since it is only used by offline style bakes
+*/
+class ComputeShader
+{
+public:
+	// Each define is inserted as "#define NAME 1" after the #version line
+	ComputeShader(const std::string& filePath, const std::vector<std::string>& defines = {});
+	~ComputeShader();
+
+	ComputeShader(const ComputeShader&) = delete;
+	ComputeShader& operator=(const ComputeShader&) = delete;
+
+	void bind() const;
+	void unbind() const;
+	// Launch enough work groups to cover the invocation counts
+	void dispatch(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ = 1) const;
+
+	unsigned int getID() const { return m_program; }
+
+	void setUniform1i(UniformId id, int value);
+	void setUniform1f(UniformId id, float value);
+
+private:
+	int getUniformLocation(UniformId id) const;
+
+	std::string m_filePath;
+	unsigned int m_program = 0;
+	unsigned int m_localSize[3] = { 1, 1, 1 };
+	std::unordered_map<uint32_t, int> m_uniforms; // Keyed by UniformId hash
+};
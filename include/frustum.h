@@ -0,0 +1,34 @@
+#pragma once
+
+#include "aabb.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/*
+	Six clip planes of a view projection matrix, each as ax + by + cz + d >= 0 for inside.
+	Works for perspective and orthographic projections alike.
+*/
+class Frustum
+{
+public:
+	enum class Containment {
+		Outside,
+		Intersecting,
+		Inside
+	};
+
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	// Mark each box at least partly inside with 1, returns the number of visible boxes.
+	// Conservative: boxes near a corner of the frustum may be kept although they are outside.
+	// Tests 8 boxes at a time with AVX, 4 with SSE2, the rest one by one.
+	size_t cull(const std::vector<AABB>& boxes, std::vector<uint8_t>& visible) const;
+
+	bool isVisible(const AABB& box) const;
+	// Also tells boxes entirely inside apart, so hierarchies can accept a whole subtree at once
+	Containment classify(const AABB& box) const;
+
+private:
+	glm::vec4 m_planes[6];
+};
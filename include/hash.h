@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64-bit FNV-1a, used to key the on-disk caches
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+inline void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+// Includes the terminator so consecutive strings cannot alias
+inline void hashString(uint64_t& hash, const char* value)
+{
+	if (value) {
+		hashBytes(hash, value, std::strlen(value) + 1);
+	}
+}
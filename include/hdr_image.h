@@ -0,0 +1,40 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "spherical_harmonics.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+	Radiance RGBE (.hdr) image read through a memory mapping. Scanlines are decoded in parallel
+	straight to half floats, the whole image never exists as floats.
+*/
+class HdrImage
+{
+public:
+	// Map the file and parse its header, returns false for anything but a "-Y H +X W" RGBE image
+	bool open(const std::string& path);
+	void close();
+
+	// Decode every scanline to RGB half floats, rows bottom to top like stb_image with the vertical flip.
+	// dst holds getHalfBytes() and is only written to, so it can be a mapped pixel buffer.
+	// The diffuse irradiance is projected from the rows while they are decoded.
+	// Returns false on truncated or corrupt data.
+	bool decode(uint16_t* dst, SHIrradiance& irradiance) const;
+
+	bool isOpen() const { return m_file.isOpen(); }
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	size_t getHalfBytes() const { return static_cast<size_t>(m_width) * m_height * 3 * sizeof(uint16_t); }
+
+private:
+	// Run-length encoded scanlines have no fixed size, so their offsets are found before decoding
+	bool findScanlines(std::vector<size_t>& offsets) const;
+	bool decodeScanline(size_t offset, unsigned char* rgbe) const;
+
+	MappedFile m_file;
+	size_t m_dataOffset = 0;
+	int m_width = 0;
+	int m_height = 0;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "spherical_harmonics.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class IblQuality {
+	Low,	// 512 environment, 128 prefilter, R11F_G11F_B10F
+	Medium,	// 1024 environment, 256 prefilter, R11F_G11F_B10F
+	High,	// 2048 environment in RGB9_E5, 512 prefilter in R11F_G11F_B10F
+	Ultra	// 2048 environment in RGB16F, 512 prefilter in RGBA16F
+};
+
+/*
+	Sizes and storage formats the image based lighting maps are baked at, part of the cache key.
+	The environment can be GL_RGB16F, GL_R11F_G11F_B10F or GL_RGB9_E5 and the prefiltered map
+	GL_RGBA16F or GL_R11F_G11F_B10F, the formats image stores can write.
+*/
+struct IblBakeParams {
+	int environmentSize = 2048;
+	int prefilterSize = 512;
+	int prefilterLevels = 10;
+	unsigned int environmentFormat = 0x8C3D; // GL_RGB9_E5
+	unsigned int prefilterFormat = 0x8C3A; // GL_R11F_G11F_B10F
+
+	static IblBakeParams forQuality(IblQuality quality);
+
+	// Full mip chain of the environment map
+	int getEnvironmentLevels() const;
+	// Video memory of each map with its mips
+	size_t getEnvironmentBytes() const;
+	size_t getPrefilterBytes() const;
+
+	static const char* getFormatName(unsigned int format);
+};
+
+/*
+	Textures holding a bake, allocated by the caller with the sizes of the bake params,
+	and the diffuse irradiance projected on the CPU
+*/
+struct IblMaps {
+	unsigned int environment = 0;
+	unsigned int prefilter = 0;
+	SHIrradiance irradiance;
+};
+
+/*
+	On-disk cache of baked IBL maps, read back with glGetTexImage in the bits of their storage format.
+	Entries are keyed by the contents of the HDR image and of the bake shaders, and by the bake params.
+	Every level is stored since shared exponent maps cannot regenerate their mips on load.
+*/
+class IblCache
+{
+public:
+	static uint64_t computeKey(const std::string& hdrPath, const std::vector<std::string>& bakeShaderPaths, const IblBakeParams& params);
+
+	// Map the entry for a key and read its irradiance, returns false when there is no valid entry.
+	// Safe to call from any thread, the textures are filled later with uploadSection.
+	static bool open(uint64_t key, const IblBakeParams& params, MappedFile& file, SHIrradiance& irradiance);
+	// Texture faces and levels in an entry, each one is uploaded separately so loads can be spread over frames
+	static size_t getSectionCount(const IblBakeParams& params);
+	// Upload one section of an opened entry, returns its size in bytes
+	static size_t uploadSection(const MappedFile& file, const IblBakeParams& params, const IblMaps& maps, size_t index);
+
+	static void store(uint64_t key, const IblBakeParams& params, const IblMaps& maps);
+
+private:
+	// One face of one level of one of the maps
+	struct Section {
+		unsigned int texture;
+		unsigned int bindTarget;
+		unsigned int imageTarget;
+		int level;
+		int size;
+		unsigned int format;
+		unsigned int type;
+		size_t bytes;
+	};
+
+	static std::vector<Section> layout(const IblBakeParams& params, const IblMaps& maps);
+	static std::string entryPath(uint64_t key);
+};
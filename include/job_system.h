@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+/*
+	Number of unfinished jobs started with it. Jobs queued with runAfter start once it
+	drops back to zero, so counters double as the edges of a small dependency graph.
+*/
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool isDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> m_pending{ 0 };
+	std::mutex m_mutex;
+	std::vector<std::pair<std::function<void()>, JobCounter*>> m_continuations;
+};
+
+/*
+	Work stealing job system for the per-frame CPU work. Each worker owns a deque, it pushes and
+	pops at the back and steals from the front of the others when it runs dry. The thread that
+	created the system owns one more deque and runs jobs while it waits, so it is never idle.
+	Jobs must not touch GL.
+*/
+class JobSystem
+{
+public:
+	static JobSystem& get();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// The counter, when given, is incremented now and decremented once the job has run
+	void run(std::function<void()> job, JobCounter* counter = nullptr);
+	// Queue the job once every job started with the dependency has finished
+	void runAfter(JobCounter& dependency, std::function<void()> job, JobCounter* counter = nullptr);
+	// Run queued jobs on the calling thread until the counter reaches zero
+	void wait(JobCounter& counter);
+
+	// Call body(begin, end) over [0, count) in chunks of at least minChunk items and return once all ran.
+	// Runs inline when there is a single chunk. Safe to call from a job.
+	void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& body);
+
+	// Worker threads plus the calling thread
+	unsigned int getThreadCount() const { return static_cast<unsigned int>(m_queues.size()); }
+
+private:
+	struct Job {
+		std::function<void()> function;
+		JobCounter* counter = nullptr;
+	};
+
+	// Mutex per deque: the owner and thieves rarely meet, the lock is uncontended in practice
+	struct JobQueue {
+		std::deque<Job> jobs;
+		std::mutex mutex;
+	};
+
+	JobSystem();
+	~JobSystem();
+
+	void workerLoop(unsigned int index);
+	void push(Job job);
+	bool pop(unsigned int index, Job& job);
+	bool steal(unsigned int index, Job& job);
+	bool findJob(Job& job);
+	void execute(Job& job);
+	void finish(JobCounter& counter);
+
+	std::vector<std::unique_ptr<JobQueue>> m_queues; // 0 belongs to the creating thread
+	std::vector<std::thread> m_workers;
+
+	// Sleeping workers wake up on new jobs
+	std::atomic<size_t> m_queuedCount{ 0 };
+	std::mutex m_sleepMutex;
+	std::condition_variable m_sleepCondition;
+	bool m_stopping = false;
+};
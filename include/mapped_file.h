@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+	Read-only memory mapping of a whole file
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+	const unsigned char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	const unsigned char* m_data = nullptr;
+	size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
+
+// One contiguous piece of a file written by writeFileAtomic
+struct FileChunk {
+	const void* data;
+	size_t size;
+};
+
+// Write the chunks one after another to path, creating its directory if needed. Caches are read
+// back without locking, so the data goes to a temporary file that only replaces path once it is
+// complete. On failure the temporary file is removed, path is left as it was and the error is printed.
+bool writeFileAtomic(const std::string& path, const std::vector<FileChunk>& chunks);
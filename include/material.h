@@ -2,16 +2,32 @@
 
 #include "shader.h"
 #include "texture.h"
+#include <string>
+#include <vector>
 #include <memory>
+#include <tuple>
 
 struct Material {
 	static const int ALBEDO_TEXTURE_UNIT = 4;
 	static const int NORMAL_TEXTURE_UNIT = 5;
 	static const int METAL_TEXTURE_UNIT = 6;
+	static const int ORM_TEXTURE_UNIT = 6; // Replaces the separate metallic, roughness and AO maps
 	static const int ROUGH_TEXTURE_UNIT = 7;
 	static const int AO_TEXTURE_UNIT = 8;
 	static const int EMISSIVE_TEXTURE_UNIT = 9;
 
+	// Shader feature bits, bit i enables FEATURE_DEFINES[i] in the PBR shader
+	static const uint32_t ALBEDO_MAP_FEATURE = 1 << 0;
+	static const uint32_t NORMAL_MAP_FEATURE = 1 << 1;
+	static const uint32_t METAL_MAP_FEATURE = 1 << 2;
+	static const uint32_t ROUGH_MAP_FEATURE = 1 << 3;
+	static const uint32_t AO_MAP_FEATURE = 1 << 4;
+	static const uint32_t ORM_MAP_FEATURE = 1 << 5;
+
+	static std::vector<std::string> featureDefines() {
+		return { "HAS_ALBEDO_MAP", "HAS_NORMAL_MAP", "HAS_METALLIC_MAP", "HAS_ROUGHNESS_MAP", "HAS_AO_MAP", "HAS_ORM_MAP" };
+	}
+
 	// Material properties
 	glm::vec3 albedo = glm::vec3(1.0f);
 	float metallic = 0.0f;
@@ -25,6 +41,7 @@ struct Material {
 	std::shared_ptr<Texture> metallicMap;
 	std::shared_ptr<Texture> roughnessMap;
 	std::shared_ptr<Texture> aoMap;
+	std::shared_ptr<Texture> ormMap; // Packed occlusion, roughness and metallic
 	std::shared_ptr<Texture> emissiveMap;
 
 	// Textures flags
@@ -33,8 +50,25 @@ struct Material {
 	bool useMetalMap = false;
 	bool useRoughMap = false;
 	bool useAoMap = false;
+	bool useOrmMap = false;
 	bool useEmissiveMap = false;
 
 	// Shader
 	std::shared_ptr<Shader> shader;
+
+	// Load the metallic, roughness and AO maps as one packed ORM texture.
+	// The use*Map flags still say which channels the shader reads, empty paths are left unused.
+	void loadOrmMap(const std::string& metallicPath, const std::string& roughnessPath, const std::string& aoPath);
+
+	// Bind the shader and textures shared by every instance drawn with this material
+	void bind() const;
+
+	// Feature mask selecting the shader variant, untextured materials get a variant without samplers
+	uint32_t getFeatures() const;
+
+	// State that forces a new draw call when it changes, scalar properties are sent per instance
+	auto bindingKey() const {
+		return std::make_tuple(shader.get(), albedoMap.get(), normalMap.get(), metallicMap.get(), roughnessMap.get(), aoMap.get(), ormMap.get(),
+			useAlbedoMap, useNormalMap, useMetalMap, useRoughMap, useAoMap, useOrmMap);
+	}
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vertex.h"
+#include "aabb.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -13,6 +14,27 @@ enum class MeshType
 	Kabuto
 };
 
+/*
+	Range of the index buffer drawn with a single material
+*/
+struct SubMesh {
+	unsigned int baseVertex = 0;
+	unsigned int firstIndex = 0;
+	unsigned int indexCount = 0;
+	unsigned int materialIndex = 0;
+};
+
+/*
+	Layout of a command in a GL_DRAW_INDIRECT_BUFFER, see glMultiDrawElementsIndirect
+*/
+struct DrawElementsIndirectCommand {
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
 class Mesh
 {
 public:
@@ -20,21 +42,50 @@ public:
 	Mesh(const std::vector<Vertex>& verts, const std::vector<unsigned int>& inds);
 	~Mesh();
 
+	// A mesh owns its range of the mesh arena
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
 	void setupMesh();
 	void loadModel(const std::string& path);
 	void draw();
+	void drawSubMesh(unsigned int index);
+	// baseInstance selects the first instance id, the shader fetches its InstanceData with it
+	void drawInstanced(unsigned int instanceCount, unsigned int baseInstance);
+
+	// Append one indirect command per submesh, for drawing the mesh through glMultiDrawElementsIndirect
+	void appendDrawCommands(std::vector<DrawElementsIndirectCommand>& commands, unsigned int instanceCount, unsigned int baseInstance);
 	void loadSphere(float radius, unsigned int segments);
 	void loadCube(float size);
 
+	const AABB& getBounds() const { return m_bounds; }
+	const std::vector<SubMesh>& getSubMeshes() const { return m_submeshes; }
+	// Size of this mesh's range in the mesh arena
+	size_t getGpuBytes() const { return m_vertexCount * sizeof(Vertex) + m_indexCount * sizeof(unsigned int); }
+
 private:
 	void processNode(aiNode* node, const aiScene* scene);
 	void processMesh(aiMesh* mesh, const aiScene* scene);
 
+	// Copy vertex and index data into the shared mesh arena, the data can come from a mapped file
+	void uploadBuffers(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+	void computeBounds();
+
+	// Binary mesh cache written next to the source model
+	bool loadCache(const std::string& sourcePath, const std::string& cachePath);
+	void writeCache(const std::string& cachePath) const;
+
 	std::vector<Vertex> m_vertices;
 	std::vector<unsigned int> m_indices;
+	std::vector<SubMesh> m_submeshes;
+	AABB m_bounds;
 
-	unsigned int m_vao, m_vbo, m_ibo;
+	// Offsets of this mesh in the mesh arena
+	unsigned int m_baseVertex = 0;
+	unsigned int m_firstIndex = 0;
+	unsigned int m_indexCount = 0;
+	size_t m_vertexCount = 0;
 
 	bool isSetup = false;
 
-};
\ No newline at end of file
+};
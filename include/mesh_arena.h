@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vertex.h"
+#include <cstddef>
+#include <vector>
+
+/*
+	Vertex and index buffers shared by every mesh, so any mesh can be drawn
+	from the same VAO and a whole frame can go through one multi-draw call
+*/
+class MeshArena
+{
+public:
+	static MeshArena& get();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	// Place the data in the first released range it fits in, else at the end of the arena, and return where it went
+	void allocate(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+		unsigned int& baseVertex, unsigned int& firstIndex);
+	// Give a range back for later allocations, the buffers keep their size
+	void release(unsigned int baseVertex, size_t vertexCount, unsigned int firstIndex, size_t indexCount);
+
+	// Instance ids 0..count-1, read by the vertex shader to index the instance data.
+	// Instanced attributes are offset by the draw baseInstance, which gives each draw its own range.
+	void reserveInstanceIds(size_t count);
+
+	void bind() const;
+
+	// End of the last range in use, released ranges below it still count
+	size_t getVertexCount() const { return m_vertexCount; }
+	size_t getIndexCount() const { return m_indexCount; }
+
+private:
+	struct Range {
+		size_t offset;
+		size_t count;
+	};
+
+	MeshArena();
+	~MeshArena();
+
+	void setupVertexAttributes();
+
+	// First fit in the free list, false when no released range is large enough
+	static bool takeRange(std::vector<Range>& freeRanges, size_t count, size_t& offset);
+	// Merge the range with its free neighbours, a range that ends the arena lowers the end instead
+	static void returnRange(std::vector<Range>& freeRanges, size_t& end, size_t offset, size_t count);
+
+	unsigned int m_vao = 0;
+	unsigned int m_vbo = 0;
+	unsigned int m_ibo = 0;
+	unsigned int m_instanceIdBuffer = 0;
+
+	size_t m_vertexCount = 0;
+	size_t m_vertexCapacity = 0;
+	size_t m_indexCount = 0;
+	size_t m_indexCapacity = 0;
+	size_t m_instanceIdCapacity = 0;
+
+	// Released ranges sorted by offset
+	std::vector<Range> m_freeVertices;
+	std::vector<Range> m_freeIndices;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/*
+	Lock-free multi-producer single-consumer FIFO (Vyukov). Any thread can push,
+	only one thread may pop. The consumer owns a stub node that is recycled on every pop.
+*/
+template<typename T>
+class MpscQueue
+{
+public:
+	MpscQueue()
+	{
+		Node* stub = new Node();
+		m_head.store(stub, std::memory_order_relaxed);
+		m_tail = stub;
+	}
+
+	~MpscQueue()
+	{
+		T value;
+		while (pop(value)) {
+		}
+		delete m_tail;
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	void push(T value)
+	{
+		Node* node = new Node();
+		node->value = std::move(value);
+		Node* previous = m_head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	// Returns false when empty, or when a producer has not finished linking its node yet
+	bool pop(T& value)
+	{
+		Node* tail = m_tail;
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next) {
+			return false;
+		}
+		value = std::move(next->value);
+		m_tail = next;
+		delete tail;
+		return true;
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next{ nullptr };
+		T value{};
+	};
+
+	std::atomic<Node*> m_head;
+	Node* m_tail;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+	Shader program creation counters, used to compare cold and warm startups
+*/
+struct ProgramCacheStats {
+	unsigned int loaded = 0;	// Programs restored from a cached binary
+	unsigned int compiled = 0;	// Programs compiled from source
+	unsigned int rejected = 0;	// Cached binaries the driver refused
+	double loadMs = 0.0;
+	double compileMs = 0.0;		// Only programs finished so far
+};
+
+/*
+	On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+	Entries are keyed by the final sources, so defines are part of the key, and by the
+	GL vendor, renderer and version strings so a driver update invalidates them.
+*/
+class ProgramCache
+{
+public:
+	static uint64_t computeKey(const std::string& vertexSource, const std::string& fragmentSource);
+
+	// Returns a linked program, or 0 when there is no usable binary for the key
+	static unsigned int load(uint64_t key);
+	// Call before linking so the driver keeps the binary around
+	static void prepare(unsigned int program);
+	static void store(uint64_t key, unsigned int program);
+
+	static void recordLoad(double ms);
+	// Counted when the compile is submitted, its time added once the program is finished
+	static void recordCompileSubmit();
+	static void recordCompile(double ms);
+	static const ProgramCacheStats& getStats() { return s_stats; }
+
+private:
+	static bool isSupported();
+	static std::string entryPath(uint64_t key);
+
+	static ProgramCacheStats s_stats;
+};
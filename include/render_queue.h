@@ -0,0 +1,75 @@
+#pragma once
+
+#include "scene.h"
+#include <vector>
+#include <memory>
+
+/*
+	Entities sharing a mesh and material bindings, drawn with one instanced call
+*/
+struct RenderBatch {
+	Mesh* mesh = nullptr;
+	const Material* material = nullptr;
+	unsigned int firstInstance = 0;
+	unsigned int instanceCount = 0;
+	unsigned int firstCommand = 0;
+	unsigned int commandCount = 0;
+};
+
+/*
+	Consecutive batches with the same material bindings, drawn with one multi-draw call
+*/
+struct DrawGroup {
+	const Material* material = nullptr;
+	unsigned int firstCommand = 0;
+	unsigned int commandCount = 0;
+};
+
+enum class SubmissionMode
+{
+	Instanced,
+	MultiDrawIndirect
+};
+
+class RenderQueue
+{
+public:
+	RenderQueue();
+	~RenderQueue();
+
+	// Sort the entities into batches and fill their instance data. No GL, so it can run as a job,
+	// and large lists are sorted on the job system. The scene transforms must be up to date.
+	// Entities marked 0 in visible are left out.
+	void prepare(const Scene& scene, const std::vector<uint8_t>* visible = nullptr);
+	// Build the draw commands of the prepared batches and upload both to the GPU, on the GL thread
+	void submit();
+
+	// Geometry pass, binds each batch material, the caller binds the frame uniforms
+	void drawGeometry();
+	// Depth only pass, the caller binds the depth shader
+	void drawDepth();
+
+	void setSubmissionMode(SubmissionMode mode) { m_mode = mode; }
+	SubmissionMode getSubmissionMode() const { return m_mode; }
+
+	size_t getBatchCount() const { return m_batches.size(); }
+	size_t getInstanceCount() const { return m_instances.size(); }
+	// Draw calls issued by the geometry pass in the current mode
+	size_t getDrawCallCount() const;
+
+private:
+	SubmissionMode m_mode = SubmissionMode::MultiDrawIndirect;
+
+	std::vector<uint32_t> m_sortedEntities; // Packed indices into the scene arrays
+	std::vector<InstanceData> m_instances;
+	std::vector<RenderBatch> m_batches;
+	std::vector<DrawGroup> m_groups;
+	std::vector<DrawElementsIndirectCommand> m_commands;
+
+	// Shader storage buffer indexed by instance id
+	unsigned int m_instanceBuffer = 0;
+	size_t m_instanceCapacity = 0;
+
+	unsigned int m_indirectBuffer = 0;
+	size_t m_indirectCapacity = 0;
+};
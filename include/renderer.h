@@ -3,16 +3,26 @@
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 #include <vector>
-#include "entity.h"
 #include "camera.h"
 #include "scene.h"
 #include "framebuffer.h"
+#include "render_queue.h"
+#include "uniform_buffer.h"
 
 #define window_width 1920
 #define window_height 1080
 
 class BloomRenderer;
 
+/*
+	Entities kept by the frustum culling of the last frame
+*/
+struct CullingStats {
+	size_t entityCount = 0;
+	size_t cameraVisible = 0;	// Drawn by the geometry pass
+	size_t lightVisible = 0;	// Drawn by the shadow depth pass
+};
+
 class Renderer
 {
 public:
@@ -20,7 +30,6 @@ public:
 	~Renderer();
 
 	void init();
-    void updateLighting();
 	void update();
 	void shutdown();
 
@@ -35,6 +44,9 @@ public:
 	std::shared_ptr<Shader> getBasicShader() { return m_basicShader; }
 	std::shared_ptr<Shader> getPBRShader() { return m_pbrShader; }
 
+	const RenderQueue& getRenderQueue() const { return *m_renderQueue; }
+	const CullingStats& getCullingStats() const { return m_cullingStats; }
+
 	GLFWwindow* getWindow() { return m_window; }
 
     static void renderQuad() {
@@ -136,6 +148,8 @@ public:
 
 	bool useSSAO = false;
 	bool useBloom = true;
+	bool useMultiDrawIndirect = true;
+	bool useFrustumCulling = true;
 	float exposure = 0.5f;
 
     glm::vec3 lightDir = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -156,14 +170,21 @@ private:
 
 	std::unique_ptr<Scene> m_currentScene;
 
+	std::unique_ptr<RenderQueue> m_renderQueue;
+	std::unique_ptr<RenderQueue> m_shadowQueue; // Same entities culled against the light frustum
+	std::vector<uint8_t> m_cameraVisibility;
+	std::vector<uint8_t> m_lightVisibility;
+	CullingStats m_cullingStats;
+	std::unique_ptr<UniformBuffer> m_frameUniforms;
+
 	std::shared_ptr<Shader> m_basicShader;
 	std::shared_ptr<Shader> m_depthShader;
 	std::shared_ptr<Shader> m_pbrShader;
-	std::unique_ptr<Shader> m_lightingShader;
-	std::unique_ptr<Shader> m_ssaoShader;
-	std::unique_ptr<Shader> m_ssaoBlurShader;
-	std::unique_ptr<Shader> m_brightShader;
-	std::unique_ptr<Shader> m_finalCompoShader;
+	std::shared_ptr<Shader> m_lightingShader;
+	std::shared_ptr<Shader> m_ssaoShader;
+	std::shared_ptr<Shader> m_ssaoBlurShader;
+	std::shared_ptr<Shader> m_brightShader;
+	std::shared_ptr<Shader> m_finalCompoShader;
 
     std::unique_ptr<Framebuffer> m_backgroundFB;
 	std::unique_ptr<Framebuffer> m_depthFB; 
@@ -210,8 +231,8 @@ private:
     bool m_init = false;
     glm::ivec2 m_srcViewportSize;
     glm::vec2 m_srcViewportSizeFloat;
-    std::unique_ptr<Shader> m_downsampleShader;
-    std::unique_ptr<Shader> m_upsampleShader;
+    std::shared_ptr<Shader> m_downsampleShader;
+    std::shared_ptr<Shader> m_upsampleShader;
 
 	std::vector<BloomMip> m_mipChain;
 
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "texture.h"
+#include "mesh.h"
+#include "shader.h"
+#include "compute_shader.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+	Totals over the resources currently alive in the cache
+*/
+struct ResourceStats {
+	size_t textureCount = 0;
+	size_t textureBytes = 0;
+	size_t meshCount = 0;
+	size_t meshBytes = 0;
+	size_t meshArenaBytes = 0; // Used part of the shared mesh buffers, includes released ranges not reused yet
+	size_t shaderCount = 0;
+	size_t hits = 0;
+	size_t misses = 0;
+};
+
+/*
+	Shared textures, meshes and shaders keyed by canonical source path and import settings.
+	Entries are weak: the cache hands out the same object for as long as anyone holds it,
+	and a resource is freed as soon as its last user drops it.
+*/
+class ResourceCache
+{
+public:
+	static ResourceCache& get();
+
+	ResourceCache(const ResourceCache&) = delete;
+	ResourceCache& operator=(const ResourceCache&) = delete;
+
+	std::shared_ptr<Texture> getTexture(const std::string& path);
+	std::shared_ptr<Texture> getOrmTexture(const std::string& occlusionPath, const std::string& roughnessPath, const std::string& metallicPath);
+
+	std::shared_ptr<Mesh> getModel(const std::string& path);
+	std::shared_ptr<Mesh> getSphere(float radius, unsigned int segments);
+	std::shared_ptr<Mesh> getCube(float size);
+
+	std::shared_ptr<Shader> getShader(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& features = {});
+	std::shared_ptr<ComputeShader> getComputeShader(const std::string& path, const std::vector<std::string>& defines = {});
+
+	// Forget the entries whose resource has been freed, called once per frame before reading the stats
+	void evictExpired();
+
+	ResourceStats getStats() const;
+
+private:
+	ResourceCache() = default;
+
+	template<typename T, typename Create>
+	std::shared_ptr<T> findOrCreate(std::unordered_map<std::string, std::weak_ptr<T>>& entries, const std::string& key, Create create)
+	{
+		auto it = entries.find(key);
+		if (it != entries.end()) {
+			if (std::shared_ptr<T> resource = it->second.lock()) {
+				m_hits++;
+				return resource;
+			}
+		}
+
+		m_misses++;
+		std::shared_ptr<T> resource = create();
+		entries[key] = resource;
+		return resource;
+	}
+
+	// Same file, same key, however the path was spelled
+	static std::string canonicalPath(const std::string& path);
+
+	std::unordered_map<std::string, std::weak_ptr<Texture>> m_textures;
+	std::unordered_map<std::string, std::weak_ptr<Mesh>> m_meshes;
+	std::unordered_map<std::string, std::weak_ptr<Shader>> m_shaders;
+	std::unordered_map<std::string, std::weak_ptr<ComputeShader>> m_computeShaders;
+
+	size_t m_hits = 0;
+	size_t m_misses = 0;
+};
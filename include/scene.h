@@ -1,31 +1,139 @@
 #pragma once
 
-#include "entity.h"
+#include "mesh.h"
+#include "material.h"
+#include "bvh.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
 
 class Skybox;
+class Frustum;
+struct SHIrradiance;
 
+/*
+	Reference to an entity of a scene. The slot is reused once the entity is destroyed,
+	the generation tells a stale handle apart from the new entity in the slot.
+*/
+struct EntityHandle {
+	uint32_t index = 0;
+	uint32_t generation = 0; // 0 is never alive
+
+	bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+using MeshId = uint32_t;
+using MaterialId = uint32_t;
+
+/*
+	Entities stored as structure of arrays. The arrays are packed, entry i of each one belongs to
+	the same entity, and destroying an entity moves the last one into its place.
+	Handles go through a slot table to find their entry.
+	World bounds are also kept in a BVH, keyed by slot so moving entries around does not touch it.
+*/
 class Scene {
 public:
 	Scene();
 	~Scene();
 
-	void addEntity(std::shared_ptr<Entity> entity);
-	void deleteEntity(std::shared_ptr<Entity> entity);
-	std::vector<std::shared_ptr<Entity>> getEntities() { return m_entities; }
+	// Materials are shared by the entities referencing them and live as long as the scene
+	MaterialId addMaterial(const Material& material);
+	Material& getMaterial(MaterialId id) { return m_materials[id]; }
+	const Material& getMaterial(MaterialId id) const { return m_materials[id]; }
+
+	EntityHandle createEntity(std::shared_ptr<Mesh> mesh, MaterialId material, const glm::vec3& position, const std::string& name = "new entity");
+	void destroyEntity(EntityHandle handle);
+	bool isAlive(EntityHandle handle) const;
+
+	// Accessors by handle, the handle must be alive
+	const glm::vec3& getPosition(EntityHandle handle) const { return m_positions[denseIndex(handle)]; }
+	const glm::vec3& getRotation(EntityHandle handle) const { return m_rotations[denseIndex(handle)]; }
+	const glm::vec3& getScale(EntityHandle handle) const { return m_scales[denseIndex(handle)]; }
+	void setPosition(EntityHandle handle, const glm::vec3& position);
+	void setRotation(EntityHandle handle, const glm::vec3& rotation); // Euler angles in degrees, applied x then y then z
+	void setScale(EntityHandle handle, const glm::vec3& scale);
+	const std::string& getName(EntityHandle handle) const { return m_names[denseIndex(handle)]; }
+	MaterialId getMaterialId(EntityHandle handle) const { return m_materialIds[denseIndex(handle)]; }
+	void setMaterialId(EntityHandle handle, MaterialId material) { m_materialIds[denseIndex(handle)] = material; }
+
+	// Rebuild the world matrices, normal matrices and world bounds of the entities moved since the last call,
+	// and bring the BVH along with them. The matrices are computed on the job system.
+	void updateTransforms();
+
+	// Spatial queries on the world bounds as of the last updateTransforms, safe to run concurrently
+	// Mark the packed entries at least partly inside the frustum, returns how many are.
+	// Small scenes are scanned linearly, larger ones go through the BVH.
+	size_t cullFrustum(const Frustum& frustum, std::vector<uint8_t>& visible) const;
+	void queryBox(const AABB& box, std::vector<EntityHandle>& handles) const;
+	// Entity whose bounds the ray enters first, a dead handle when it hits none
+	EntityHandle raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance = nullptr) const;
+	// SAH build over all entities, done automatically when refits have degraded the tree
+	void rebuildSpatialIndex();
+	const Bvh& getSpatialIndex() const { return m_bvh; }
+
+	// Packed arrays, valid until the next create or destroy
+	size_t getEntityCount() const { return m_positions.size(); }
+	EntityHandle getHandle(size_t i) const { return { m_denseToSlot[i], m_generations[m_denseToSlot[i]] }; }
+	const std::vector<glm::mat4>& getWorldMatrices() const { return m_worldMatrices; }
+	const std::vector<glm::mat4>& getNormalMatrices() const { return m_normalMatrices; } // Inverse transpose of the world matrices
+	const std::vector<AABB>& getWorldBounds() const { return m_worldBounds; }
+	const std::vector<MeshId>& getMeshIds() const { return m_meshIds; }
+	const std::vector<MaterialId>& getMaterialIds() const { return m_materialIds; }
+	Mesh* getMesh(MeshId id) const { return m_meshes[id].get(); }
 
 	glm::vec3& getNewEntityPosition() { return m_newEntityPosition; }
 	bool& getIsAddingEntity() { return m_isAddingEntity; }
 
-	void draw(const glm::mat4& view, const glm::mat4& projection);
+	// Bind the IBL textures sampled by the PBR shader
+	void bindEnvironment();
+	// Switch the skybox hdr image, baked in the background over the next frames
+	void setEnvironment(const std::string& path);
+	// Advance a pending environment switch, call once per frame before rendering
+	void updateEnvironment();
+	Skybox* getSkybox() const { return m_skybox.get(); }
+	// Diffuse irradiance of the skybox, zero without one
+	SHIrradiance getIrradianceSH() const;
 
 	void drawSkybox(const glm::mat4& view, const glm::mat4& projection);
 
 private:
-	std::vector<std::shared_ptr<Entity>> m_entities;
+	uint32_t denseIndex(EntityHandle handle) const { return m_slotToDense[handle.index]; }
+	MeshId registerMesh(std::shared_ptr<Mesh> mesh);
+
+	// Hot data, streamed by the per-frame passes
+	std::vector<glm::vec3> m_positions;
+	std::vector<glm::vec3> m_rotations;
+	std::vector<glm::vec3> m_scales;
+	std::vector<glm::mat4> m_worldMatrices;
+	std::vector<glm::mat4> m_normalMatrices;
+	std::vector<AABB> m_worldBounds;
+	std::vector<MeshId> m_meshIds;
+	std::vector<MaterialId> m_materialIds;
+	std::vector<uint8_t> m_transformDirty;
+	bool m_anyTransformDirty = false;
+	std::vector<int32_t> m_bvhProxies; // Leaf of each entity, Bvh::NULL_NODE until its first transform update
+
+	// Cold data, only read by the editor
+	std::vector<std::string> m_names;
+
+	// Slot table: handle index to packed index and back
+	std::vector<uint32_t> m_denseToSlot;
+	std::vector<uint32_t> m_slotToDense;
+	std::vector<uint32_t> m_generations;
+	std::vector<uint32_t> m_freeSlots;
+
+	std::vector<std::shared_ptr<Mesh>> m_meshes;
+	std::deque<Material> m_materials; // Stable addresses, the render queue keeps pointers for the frame
+
+	Bvh m_bvh;
+	float m_bvhBuildCost = 0.0f; // Cost right after the last SAH build
 
 	glm::vec3 m_newEntityPosition = glm::vec3(0.0f);
 	bool m_isAddingEntity = false;
 
 	std::unique_ptr<Skybox> m_skybox;
 	
-};
\ No newline at end of file
+};
@@ -1,39 +1,85 @@
 #pragma once
 
+#include "uniform_id.h"
 #include <string>
-#include <unordered_map>
 #include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <chrono>
 #include <glm/glm.hpp>
 
+/*
+	Shader program compiled in variants, one per set of feature defines.
+	Feature bit i of a variant mask enables "#define <features[i]>" in both stages.
+	Variants are submitted without waiting on the driver; with GL_KHR_parallel_shader_compile
+	a variant that is still compiling is replaced by the base variant until it is ready.
+*/
 class Shader
 {
 private:
-	unsigned int m_shaderID;
+	// Active uniforms of a linked program sorted by hash, the last entry is a sentinel
+	struct UniformSlot {
+		uint32_t hash;
+		int location;
+	};
+
+	struct Variant {
+		unsigned int program = 0;
+		// Stages still attached while the link is pending
+		unsigned int vertexShader = 0;
+		unsigned int fragmentShader = 0;
+		uint64_t cacheKey = 0;
+		bool ready = false;
+		std::chrono::steady_clock::time_point submitTime;
+		std::vector<UniformSlot> uniforms;
+	};
+
 	std::string m_vertexFilePath;
 	std::string m_fragmentFilePath;
-	std::unordered_map<std::string, int> m_UniformLocationCache; // Cache for uniforms
+	std::string m_vertexSource;
+	std::string m_fragmentSource;
+
+	std::vector<std::string> m_features;
+	std::unordered_map<uint32_t, Variant> m_variants; // Keyed by feature mask
+	Variant* m_current = nullptr;
 
-	unsigned int compile();
-	int getUniformLocation(const std::string& name);
+	bool loadSources();
+	std::string injectDefines(const std::string& source, uint32_t features) const;
+	Variant& getVariant(uint32_t features);
+	// Queue the compile and link without querying any status
+	void submit(Variant& variant, uint32_t features);
+	bool isComplete(const Variant& variant) const;
+	// Wait for the link, print the logs and reflect the uniforms
+	void finish(Variant& variant);
+	void reflectUniforms(Variant& variant);
+	// Unknown ids resolve to -1, which glUniform* ignores
+	int getUniformLocation(UniformId id) const;
 
 public:
-	Shader(const std::string& vertexFilePath, const std::string& fragmentFilePath);
+	Shader(const std::string& vertexFilePath, const std::string& fragmentFilePath, const std::vector<std::string>& features = {});
 	~Shader();
 
-	void bind() const;
+	// Start compiling a variant ahead of its first bind
+	void prepare(uint32_t features);
+	bool isReady(uint32_t features);
+
+	// Bind the variant for a feature mask, or the base variant while it is still compiling.
+	// Setters apply to the bound variant.
+	void bind(uint32_t features = 0);
 	void unbind() const;
 
-	unsigned int getID() const { return m_shaderID; }
+	unsigned int getID() const { return m_current ? m_current->program : 0; }
+	size_t getVariantCount() const { return m_variants.size(); }
 
 	// Set uniforms
-	void setUniform1i(const std::string& name, int value);
-	void setUniform1f(const std::string& name, float value);
-	void setUniform2f(const std::string& name, float v0, float v1);
-	void setUniform3f(const std::string& name, float v0, float v1, float v2);
-	void setUniform4f(const std::string& name, float v0, float v1, float v2, float v3);
-	void setUniformMat3f(const std::string& name, const glm::mat3& matrix);
-	void setUniformMat4f(const std::string& name, const glm::mat4& matrix);
-	void setUniformVec3f(const std::string& name, const glm::vec3& vector);
-	void setUniformBool(const std::string& name, bool value);
-	void setUniform3fv(const std::string& name, const std::vector<glm::vec3> vector, int count);
+	void setUniform1i(UniformId id, int value);
+	void setUniform1f(UniformId id, float value);
+	void setUniform2f(UniformId id, float v0, float v1);
+	void setUniform3f(UniformId id, float v0, float v1, float v2);
+	void setUniform4f(UniformId id, float v0, float v1, float v2, float v3);
+	void setUniformMat3f(UniformId id, const glm::mat3& matrix);
+	void setUniformMat4f(UniformId id, const glm::mat4& matrix);
+	void setUniformVec3f(UniformId id, const glm::vec3& vector);
+	void setUniformBool(UniformId id, bool value);
+	void setUniform3fv(UniformId id, const std::vector<glm::vec3> vector, int count);
 };
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "shader.h"
+#include "compute_shader.h"
+#include "ibl_cache.h"
+#include "brdf_lut.h"
 #include <memory>
 #include <vector>
 #include <string>
+#include <deque>
+#include <functional>
 #include <glm/glm.hpp>
 #include "glad/glad.h"
 
@@ -15,38 +20,85 @@ public:
 	void draw(const glm::mat4& view, const glm::mat4& projection);
     void bindTextures();
 
-	// Load hdr image from path and generate environment cubemap
+	// Load hdr image from path and generate environment cubemap, blocks until the maps are ready
     void loadHDRImage(std::string path);
+	// Switch to another hdr image without a hitch: it is decoded on a worker thread and baked
+	// over the next frames by update(). The current maps stay in use until the new set is complete.
+    void setEnvironment(const std::string& path);
+	// Run the pending bake steps that fit in the per-frame GPU budget
+    void update();
 
-    unsigned int getIrradianceMap() { return m_irradianceMap; }
+    bool isRebuilding() const { return m_pending != nullptr; }
+    size_t getPendingSteps() const;
+    const std::string& getEnvironmentPath() const { return m_environmentPath; }
+
+    float rebuildBudgetMs = 2.0f;
+
+	// Sizes and storage formats of the maps, rebakes the current environment
+    void setQuality(IblQuality quality);
+    IblQuality getQuality() const { return m_quality; }
+	// Params of the maps in use, which lag behind the quality while a rebake is in flight
+    const IblBakeParams& getBakeParams() const { return m_activeParams; }
+    size_t getMemoryBytes() const;
+
+    const SHIrradiance& getIrradianceSH() const { return m_irradianceSH; }
     unsigned int getPrefilterMap() { return m_prefilterMap; }
-    unsigned int getBRDFLUT() { return brdfLUTTexture; }
-    unsigned int getMipLevels() { return maxMipLevels; }
+    unsigned int getBRDFLUT() { return BrdfLut::getTexture(); }
+    int getMipLevels() const { return m_activeParams.prefilterLevels; }
 
 private:
     std::vector<float> m_skyboxVertices;
 
     unsigned int m_skyboxVAO, m_skyboxVBO;
 
-    std::unique_ptr<Shader> m_skyboxShader;
-    std::unique_ptr<Shader> m_equirectangularToCubemapShader;
-    std::unique_ptr<Shader> m_irradianceShader;
-    std::unique_ptr<Shader> m_prefilterShader;
-    std::unique_ptr<Shader> m_brdfShader;
+    std::shared_ptr<Shader> m_skyboxShader;
+    std::shared_ptr<Shader> m_equirectangularToCubemapShader;
 
-    unsigned int m_hdrTexture, m_envCubemap, m_irradianceMap, m_prefilterMap;
+    unsigned int m_envCubemap = 0, m_prefilterMap = 0;
+    SHIrradiance m_irradianceSH;
+    std::string m_environmentPath;
     unsigned int captureFBO, captureRBO;
+    int m_captureSize = 0; // Size of the depth storage of captureRBO
     unsigned int cubeVAO = 0;
     unsigned int cubeVBO = 0;
     unsigned int quadVAO = 0;
     unsigned int quadVBO;
 
+    IblQuality m_quality = IblQuality::High;
+    IblBakeParams m_bakeParams; // Used by the next switch
+    IblBakeParams m_activeParams; // Of the maps in use
+
+	// Slice of an environment switch, cost is an estimate in texels touched
+    struct BakeStep {
+        double cost;
+        std::function<void()> run;
+    };
+    struct PendingEnvironment;
+    std::unique_ptr<PendingEnvironment> m_pending;
+    std::string m_queuedPath; // Latest switch requested while another one was in flight
 
-    unsigned int brdfLUTTexture;
-    int maxMipLevels = 10;
+	// GPU time of the bake slices, read back a few frames later to calibrate the budget
+    static const int TIMER_QUERY_COUNT = 4;
+    unsigned int m_timerQueries[TIMER_QUERY_COUNT] = {};
+    double m_timerQueryCost[TIMER_QUERY_COUNT] = {}; // 0 when the query is free
+    int m_nextTimerQuery = 0;
+    double m_nsPerCost = 0.1; // Estimate until the first slice has been measured
+    bool m_timerCalibrated = false;
 
-	// Generate environment cubemap from the loaded hdr image
-    void loadCubemap();
+	// Create the storage of the environment dependent maps, filled either by the bake or from the cache
+    IblMaps allocateMaps(const IblBakeParams& params);
+    void resizeCaptureDepth(int size);
+	// Queue the uploads and draws that produce the new maps once the worker has decoded the image,
+	// returns false when the image could not be decoded
+    bool buildBakeSteps(PendingEnvironment& pending);
+	// Block until the pending switch is done, used for the first environment
+    void finishPending();
+	// Free everything owned by a switch that will not complete
+    void abortPending();
+	// Swap in the new maps, the previous ones are freed
+    void completeEnvironment(bool storeInCache);
+    void startQueuedEnvironment();
+    void readTimerQueries();
 
 	// Utilities functions
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+/*
+	Diffuse irradiance of an environment as 9 L2 spherical harmonics coefficients.
+	The cosine lobe and the basis constants are already folded in, the shader evaluates
+	c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2)
+	and gets the same value the irradiance convolution used to store, irradiance / PI.
+	vec4 per coefficient so the array can be copied into a std140 block as is.
+*/
+struct SHIrradiance {
+	glm::vec4 coefficients[9] = {};
+};
+
+/*
+	Running projection of the rows of an equirectangular radiance map, for decoders that
+	produce rows on several threads. Each thread owns one, they are merged in row order.
+*/
+class SHAccumulator
+{
+public:
+	SHAccumulator(int width, int height);
+
+	// Row counted bottom to top, pixels with at least 3 float channels.
+	// Integrated 4 texels at a time.
+	void addRow(int row, const float* pixels, int channels);
+	void merge(const SHAccumulator& other);
+	SHIrradiance getIrradiance() const;
+
+private:
+	int m_width;
+	int m_height;
+	std::vector<float> m_cosPhi, m_sinPhi;
+	std::vector<float> m_red, m_green, m_blue;
+	std::array<double, 27> m_sums = {};
+};
+
+class SphericalHarmonics
+{
+public:
+	// Project an equirectangular radiance map, rows bottom to top as loaded with the vertical flip.
+	// Rows are split across threads.
+	static SHIrradiance projectEquirectangular(const float* pixels, int width, int height, int channels);
+
+	// Reference evaluation, matches the one in pbr_frag.glsl
+	static glm::vec3 evaluate(const SHIrradiance& sh, const glm::vec3& normal);
+};
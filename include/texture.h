@@ -2,30 +2,56 @@
 
 #include "glad/glad.h"
 #include <string>
+#include <memory>
 
 enum class TextureType {
 	ALBEDO,
 	NORMAL,
 	METALLIC,
 	ROUGHNESS,
-	AO
+	AO,
+	ORM		// Occlusion, roughness and metallic packed in R, G and B
 };
 
+enum class TextureState {
+	Pending,	// Decoding or waiting for upload, a placeholder is bound instead
+	Ready,
+	Failed
+};
+
+struct TextureRequest;
+
 class Texture {
 
 public:
 	Texture();
+	// Load asynchronously through the TextureLoader
 	Texture(std::string path);
+	// Pack three single channel maps into one ORM texture, asynchronously. Empty paths are left white.
+	Texture(const std::string& occlusionPath, const std::string& roughnessPath, const std::string& metallicPath);
 	~Texture();
 
+	// Load synchronously on the calling thread
 	void load(const char* path);
 	void bind(unsigned int slot = 0) const;
 	void unbind() const;
 
+	TextureState getState() const;
+	bool isReady() const { return getState() == TextureState::Ready; }
+	// Video memory of all levels, 0 until the texture is uploaded
+	size_t getGpuBytes() const;
+
+	static TextureType typeFromPath(const std::string& path);
+	// Color maps are sRGB, everything else is linear. Returns false for unsupported channel counts.
+	static bool getUploadFormat(TextureType type, int channels, GLenum& internalFormat, GLenum& format);
+
 private:
+	void create();
 
-	unsigned int m_id;
-	TextureType m_type;
+	unsigned int m_id = 0;
+	TextureType m_type = TextureType::ALBEDO;
+	size_t m_gpuBytes = 0; // Synchronous loads only, async ones record it in their request
+	std::shared_ptr<TextureRequest> m_request;
 
 	bool m_isNormalMap = false;
-};
\ No newline at end of file
+};
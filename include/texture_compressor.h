@@ -0,0 +1,63 @@
+#pragma once
+
+#include "texture.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class BlockFormat {
+	BC4,		// One channel, 8 bytes per block
+	BC5,		// Two channels, 16 bytes per block
+	BC7_SRGB,	// RGBA in sRGB, 16 bytes per block
+	BC7			// Linear RGBA, 16 bytes per block
+};
+
+/*
+	Block compressed image with its full mip chain, levels are stored back to back
+*/
+struct CompressedImage {
+	BlockFormat format = BlockFormat::BC7_SRGB;
+	int width = 0;
+	int height = 0;
+	std::vector<size_t> levelOffsets; // One more entry than levels, the last one is the total size
+	std::vector<unsigned char> data;
+
+	int getLevelCount() const { return levelOffsets.empty() ? 0 : static_cast<int>(levelOffsets.size()) - 1; }
+	int getLevelWidth(int level) const { return width >> level > 0 ? width >> level : 1; }
+	int getLevelHeight(int level) const { return height >> level > 0 ? height >> level : 1; }
+	size_t getLevelSize(int level) const { return levelOffsets[level + 1] - levelOffsets[level]; }
+};
+
+/*
+	CPU block compression of texture maps: albedo to BC7, normals to BC5,
+	single channel maps to BC4 and packed ORM maps to linear BC7.
+	Results are cached as DDS files next to the other caches.
+*/
+class TextureCompressor
+{
+public:
+	static BlockFormat formatFor(TextureType type);
+	static unsigned int getGLFormat(BlockFormat format);
+	static size_t getBlockSize(BlockFormat format) { return format == BlockFormat::BC4 ? 8 : 16; }
+	static const char* getFormatName(BlockFormat format);
+
+	// Load the cached compressed image for a source file, compressing and caching it on a miss
+	static bool loadOrCompress(const std::string& path, BlockFormat format, CompressedImage& image);
+	// Same for a texture packed from the red channel of several sources, one per output channel.
+	// Sources are resampled to the size of the largest one, missing channels are white.
+	static bool loadOrPack(const std::vector<std::string>& channelPaths, BlockFormat format, CompressedImage& image);
+
+	// Build the mip chain of an RGBA8 image and encode every level
+	static void compress(const unsigned char* rgba, int width, int height, BlockFormat format, CompressedImage& image);
+
+	// Encode one 4x4 block of RGBA8 pixels
+	static void encodeBC4Block(const unsigned char* block, unsigned char* out);
+	static void encodeBC5Block(const unsigned char* block, unsigned char* out);
+	static void encodeBC7Block(const unsigned char* block, unsigned char* out);
+
+	static bool readDDS(const std::string& path, CompressedImage& image);
+	static bool writeDDS(const std::string& path, const CompressedImage& image);
+
+private:
+	static std::string cachePath(const std::vector<std::string>& sourcePaths, BlockFormat format);
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "texture.h"
+#include "texture_compressor.h"
+#include "mpsc_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	Texture waiting for its pixels. Created on the GL thread, decoded by a worker
+	and uploaded back on the GL thread. The Texture cancels it when destroyed first.
+*/
+struct TextureRequest {
+	std::string path;
+	std::vector<std::string> channelPaths; // Sources of a packed texture, one per channel
+	unsigned int texture = 0;
+	TextureType type = TextureType::ALBEDO;
+	TextureState state = TextureState::Pending; // GL thread only
+	size_t gpuBytes = 0;
+	std::atomic<bool> cancelled{ false };
+};
+
+/*
+	Decodes and block compresses images on a pool of worker threads (or reads them back
+	from the compressed cache) and uploads them on the GL thread through a pixel unpack
+	buffer, spending at most the upload budget each frame
+*/
+class TextureLoader
+{
+public:
+	static TextureLoader& get();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	void request(const std::shared_ptr<TextureRequest>& request);
+
+	// Upload decoded images until the budget is spent, call once per frame on the GL thread.
+	// At least one image is uploaded per call so large images still make progress.
+	void update();
+
+	// 1x1 texture bound in place of a texture that is not ready, neutral for its type
+	unsigned int getPlaceholder(TextureType type);
+
+	void setUploadBudget(size_t bytes) { m_uploadBudget = bytes; }
+	size_t getUploadBudget() const { return m_uploadBudget; }
+	size_t getPendingCount() const { return m_pending.load(std::memory_order_relaxed); }
+
+private:
+	struct DecodedImage {
+		std::shared_ptr<TextureRequest> request;
+		CompressedImage image; // Empty when loading failed
+	};
+
+	TextureLoader();
+	~TextureLoader();
+
+	void workerLoop();
+	void upload(const DecodedImage& image);
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::shared_ptr<TextureRequest>> m_jobs;
+	std::mutex m_jobMutex;
+	std::condition_variable m_jobCondition;
+	bool m_stopping = false;
+
+	// Worker to GL thread hand-off
+	MpscQueue<DecodedImage> m_decoded;
+	std::atomic<size_t> m_pending{ 0 };
+
+	unsigned int m_pbo = 0;
+	size_t m_pboCapacity = 0;
+	size_t m_uploadBudget = 16 << 20;
+
+	unsigned int m_placeholders[6] = {};
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "spherical_harmonics.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+	std140 mirror of FrameBlock, written once per frame
+*/
+struct FrameUniforms {
+	static const unsigned int BINDING = 0;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 lightSpaceMatrix;
+	glm::vec3 camPos;
+	float pad0;
+	glm::vec3 lightDir;
+	float pad1;
+	glm::vec3 lightColor;
+	float pad2;
+	SHIrradiance irradianceSH;
+};
+
+static_assert(sizeof(FrameUniforms) == 384, "FrameUniforms must match the std140 layout of FrameBlock");
+
+class UniformBuffer
+{
+public:
+	UniformBuffer(size_t size, unsigned int binding);
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	void update(const void* data, size_t size, size_t offset = 0);
+	// Reallocate the storage, previous contents are lost
+	void resize(size_t size);
+
+	// Bind the whole buffer to its binding point
+	void bind() const;
+	// Bind one slot of the buffer, offset must be a multiple of getOffsetAlignment()
+	void bindRange(size_t offset, size_t size) const;
+
+	size_t getSize() const { return m_size; }
+	static size_t getOffsetAlignment();
+
+private:
+	unsigned int m_ubo = 0;
+	unsigned int m_binding = 0;
+	size_t m_size = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+/*
+	Uniform name hashed with FNV-1a. String literals convert at compile time,
+	so setting a uniform never hashes or allocates at runtime.
+*/
+struct UniformId {
+	uint32_t hash = 0;
+
+	consteval UniformId(const char* name) : hash(compute(name)) {}
+
+	// Runtime hashing, used when reflecting the names of a linked program
+	static constexpr UniformId fromName(std::string_view name) { return UniformId(compute(name)); }
+
+	static constexpr uint32_t compute(std::string_view name)
+	{
+		uint32_t value = 2166136261u;
+		for (char c : name) {
+			value ^= static_cast<uint8_t>(c);
+			value *= 16777619u;
+		}
+		return value;
+	}
+
+	constexpr bool operator==(const UniformId& other) const { return hash == other.hash; }
+	constexpr bool operator<(const UniformId& other) const { return hash < other.hash; }
+
+private:
+	constexpr explicit UniformId(uint32_t value) : hash(value) {}
+};
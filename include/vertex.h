@@ -11,4 +11,18 @@ struct Vertex {
 	glm::vec2 m_texCoords;
 	glm::vec3 m_tangent;
 	glm::vec3 m_bitangent;
-};
\ No newline at end of file
+};
+
+/*
+	Per-instance data, streamed by the render queue into a shader storage buffer
+*/
+struct InstanceData {
+	glm::mat4 model;
+	glm::mat4 normalMatrix;			// Inverse transpose of model, only the upper 3x3 is used
+	glm::vec4 albedoMetallic;		// rgb: albedo, a: metallic
+	glm::vec4 emissiveRoughness;	// rgb: emissive color, a: roughness
+	glm::vec4 ao;					// x: ambient occlusion
+};
+
+// Read from a std430 shader storage block, keep it a multiple of 16 bytes
+static_assert(sizeof(InstanceData) % 16 == 0, "InstanceData must match the std430 layout");
@@ -5,6 +5,21 @@ layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
 
+// Index into the instance buffer, offset by the draw baseInstance
+layout (location = 5) in uint aInstanceIndex;
+
+struct InstanceData {
+	mat4 model;
+	mat4 normalMatrix;
+	vec4 albedoMetallic;
+	vec4 emissiveRoughness;
+	vec4 ao;
+};
+
+layout (std430, binding = 0) readonly buffer InstanceBuffer {
+	InstanceData instances[];
+};
+
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
@@ -12,11 +27,28 @@ out mat3 TBN;
 out vec3 ViewPos;
 out mat4 VM;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+flat out vec4 AlbedoMetallic;
+flat out vec4 EmissiveRoughness;
+flat out float AO;
+
+// Per-frame uniforms, see FrameUniforms
+layout (std140, binding = 0) uniform FrameBlock {
+	mat4 view;
+	mat4 projection;
+	mat4 lightSpaceMatrix;
+	vec3 camPos;
+	vec3 lightDir;
+	vec3 lightColor;
+};
 
 void main() {
+	InstanceData instance = instances[aInstanceIndex];
+	mat4 model = instance.model;
+
+	AlbedoMetallic = instance.albedoMetallic;
+	EmissiveRoughness = instance.emissiveRoughness;
+	AO = instance.ao.x;
+
 	WorldPos = vec3(model * vec4(aPos, 1.0));
 
 	ViewPos = vec3(view * model * vec4(aPos, 1.0));
@@ -25,7 +57,7 @@ void main() {
 
 	TexCoords = aTexCoords;
 
-	mat3 normalMatrix = mat3(transpose(inverse(model)));
+	mat3 normalMatrix = mat3(instance.normalMatrix);
 	Normal = normalMatrix * aNormal;
 
 	// TBN matrix
@@ -1,10 +1,29 @@
 #version 450 core
 
 layout(location=0) in vec3 aPos;
+layout(location=5) in uint aInstanceIndex;
 
-uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+struct InstanceData {
+  mat4 model;
+  mat4 normalMatrix;
+  vec4 albedoMetallic;
+  vec4 emissiveRoughness;
+  vec4 ao;
+};
+
+layout(std430, binding=0) readonly buffer InstanceBuffer {
+  InstanceData instances[];
+};
+
+layout(std140, binding=0) uniform FrameBlock {
+  mat4 view;
+  mat4 projection;
+  mat4 lightSpaceMatrix;
+  vec3 camPos;
+  vec3 lightDir;
+  vec3 lightColor;
+};
 
 void main() {
-  gl_Position = lightSpaceMatrix * model * vec4(aPos,1.0);
+  gl_Position = lightSpaceMatrix * instances[aInstanceIndex].model * vec4(aPos,1.0);
 }
\ No newline at end of file
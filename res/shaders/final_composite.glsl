@@ -7,22 +7,22 @@ uniform sampler2D sceneTexture;       // The scene with lighting applied
 uniform sampler2D bloomTexture;       // The blurred bloom texture
 uniform float exposure;               // Exposure value for tone mapping
 
-uniform bool useBloom; // Flag to enable/disable bloom effect
+// USE_BLOOM is a shader feature define, set by the renderer
 
 void main()
 {
     // Retrieve all textures
     vec4 backgroundColor = texture(backgroundTexture, TexCoords);
     vec4 sceneColor = texture(sceneTexture, TexCoords);
-    vec3 bloomColor = texture(bloomTexture, TexCoords).rgb * 0.25; // Adjust bloom intensity
     
     // Blend scene over background
     vec3 combinedColor = mix(backgroundColor.rgb, sceneColor.rgb, sceneColor.a);
 
     // Apply bloom if enabled
-    if (useBloom) {
-        combinedColor += bloomColor;
-    }
+#ifdef USE_BLOOM
+    vec3 bloomColor = texture(bloomTexture, TexCoords).rgb * 0.25; // Adjust bloom intensity
+    combinedColor += bloomColor;
+#endif
     
     // Apply HDR tone mapping to combined scene and bloom
     vec3 hdrCombined = combinedColor;
@@ -0,0 +1,37 @@
+#version 450 core
+// Copies one level of a face into a GL_RGB9_E5 cubemap through its GL_R32UI view,
+// shared exponent textures can neither be rendered to nor written by image stores
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout (binding = 0) uniform sampler2D source;
+layout (binding = 0, r32ui) uniform writeonly uimageCube destination;
+
+uniform int level;
+uniform int levelSize;
+uniform int face;
+
+// EXT_texture_shared_exponent encoding: 9 bit mantissas sharing a 5 bit exponent
+uint PackRGB9E5(vec3 color)
+{
+    const float MAX_VALUE = 65408.0; // (2^9 - 1) / 2^9 * 2^(31 - 15)
+    vec3 c = clamp(color, 0.0, MAX_VALUE);
+    float maxChannel = max(c.r, max(c.g, c.b));
+    int exponent = max(-16, int(floor(log2(max(maxChannel, 1e-30))))) + 1 + 15;
+    float scale = exp2(float(exponent - 15 - 9));
+    if (int(floor(maxChannel / scale + 0.5)) == 512) {
+        exponent += 1;
+        scale *= 2.0;
+    }
+    uvec3 mantissa = uvec3(floor(c / scale + 0.5));
+    return mantissa.r | (mantissa.g << 9) | (mantissa.b << 18) | (uint(exponent) << 27);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= levelSize || texel.y >= levelSize) {
+        return;
+    }
+    vec3 color = texelFetch(source, texel, level).rgb;
+    imageStore(destination, ivec3(texel, face), uvec4(PackRGB9E5(color), 0u, 0u, 0u));
+}
@@ -11,44 +11,50 @@ in mat3 TBN;
 in vec3 ViewPos;
 in mat4 VM;
 
-uniform vec3 camPos;
-
-// light parameters
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-
-// PBR material
-struct Material {
-    bool useAlbedoTexture;
-    bool useMetallicTexture;
-    bool useRoughnessTexture;
-    bool useAoTexture;
-    bool useNormalTexture;
-
-    vec3 albedo;
-    float metallic;
-    float roughness;
-    float ao;
-    vec3 emissiveColor;
-
-    sampler2D albedoMap;
-    sampler2D normalMap;
-    sampler2D metallicMap;
-    sampler2D roughnessMap;
-    sampler2D aoMap;
+// Per-instance material properties
+flat in vec4 AlbedoMetallic;
+flat in vec4 EmissiveRoughness;
+flat in float AO;
+
+// Per-frame uniforms, see FrameUniforms
+layout (std140, binding = 0) uniform FrameBlock {
+    mat4 view;
+    mat4 projection;
+    mat4 lightSpaceMatrix;
+    vec3 camPos;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec4 irradianceSH[9];  // Diffuse IBL, see SHIrradiance
 };
 
-uniform Material material;
-
-// environment cubemap
-uniform samplerCube irradianceMap;
+// Material textures, units match Material::*_TEXTURE_UNIT.
+// Each map is a feature define, see Material::featureDefines()
+#ifdef HAS_ALBEDO_MAP
+layout (binding = 4) uniform sampler2D albedoMap;
+#endif
+#ifdef HAS_NORMAL_MAP
+layout (binding = 5) uniform sampler2D normalMap;
+#endif
+#ifdef HAS_ORM_MAP
+// Occlusion, roughness and metallic in one texture, the HAS_*_MAP defines still select the channels used
+layout (binding = 6) uniform sampler2D ormMap;
+#else
+#ifdef HAS_METALLIC_MAP
+layout (binding = 6) uniform sampler2D metallicMap;
+#endif
+#ifdef HAS_ROUGHNESS_MAP
+layout (binding = 7) uniform sampler2D roughnessMap;
+#endif
+#ifdef HAS_AO_MAP
+layout (binding = 8) uniform sampler2D aoMap;
+#endif
+#endif
 
 // Specular IBL prefiltered map
-uniform samplerCube prefilterMap;
-uniform sampler2D brdfLUT;
+layout (binding = 1) uniform samplerCube prefilterMap;
+layout (binding = 2) uniform sampler2D brdfLUT;
 
-uniform sampler2D shadowMap;
-uniform mat4     lightSpaceMatrix;
+layout (binding = 19) uniform sampler2D shadowMap;
 
 const float PI = 3.14159265359;
 
@@ -57,6 +63,7 @@ float GeometrySchlickGGX(float NdotV, float roughness);
 float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
 vec3 fresnelSchlick(float cosTheta, vec3 F0);
 vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness);
+vec3 IrradianceSH(vec3 N);
 
 float ShadowCalculation(vec4 fragPosLightSpace)
 {
@@ -80,32 +87,43 @@ float ShadowCalculation(vec4 fragPosLightSpace)
 void main()
 {
     // Material properties calculation
-    vec3 albedo = material.albedo;
-    if(material.useAlbedoTexture) {
-        albedo = pow(texture(material.albedoMap, TexCoords).rgb, vec3(2.2));
-    }
-
-    float metallic = material.metallic;
-    if(material.useMetallicTexture) {
-        metallic = texture(material.metallicMap, TexCoords).r;
-    }
-
-    float roughness = material.roughness;
-    if(material.useRoughnessTexture) {
-        roughness = texture(material.roughnessMap, TexCoords).r;
-    }
-
-    float ao = material.ao;
-    if(material.useAoTexture) {
-        ao = texture(material.aoMap, TexCoords).r;
-    }
+    vec3 albedo = AlbedoMetallic.rgb;
+#ifdef HAS_ALBEDO_MAP
+    albedo = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+#endif
+
+#ifdef HAS_ORM_MAP
+    vec3 orm = texture(ormMap, TexCoords).rgb;
+#endif
+
+    float metallic = AlbedoMetallic.a;
+#if defined(HAS_ORM_MAP) && defined(HAS_METALLIC_MAP)
+    metallic = orm.b;
+#elif defined(HAS_METALLIC_MAP)
+    metallic = texture(metallicMap, TexCoords).r;
+#endif
+
+    float roughness = EmissiveRoughness.a;
+#if defined(HAS_ORM_MAP) && defined(HAS_ROUGHNESS_MAP)
+    roughness = orm.g;
+#elif defined(HAS_ROUGHNESS_MAP)
+    roughness = texture(roughnessMap, TexCoords).r;
+#endif
+
+    float ao = AO;
+#if defined(HAS_ORM_MAP) && defined(HAS_AO_MAP)
+    ao = orm.r;
+#elif defined(HAS_AO_MAP)
+    ao = texture(aoMap, TexCoords).r;
+#endif
     
     vec3 N = normalize(Normal);
-    if (material.useNormalTexture) {
-        vec3 tangentNormal = texture(material.normalMap, TexCoords).rgb;
-        tangentNormal = tangentNormal * 2.0 - 1.0;
-        N = normalize(TBN * tangentNormal);
-    }
+#ifdef HAS_NORMAL_MAP
+    // Normal maps may be two channel BC5, rebuild z from the unit length
+    vec2 tangentXY = texture(normalMap, TexCoords).rg * 2.0 - 1.0;
+    vec3 tangentNormal = vec3(tangentXY, sqrt(max(1.0 - dot(tangentXY, tangentXY), 0.0)));
+    N = normalize(TBN * tangentNormal);
+#endif
 
     vec3 viewSpaceN = normalize(mat3(VM) * N); // transform normal to view space for output gNormal
 
@@ -133,13 +151,14 @@ void main()
 
     // IBL (ambient lighting)
     // Diffuse IBL
-    vec3 irradiance    = texture(irradianceMap, N).rgb;
+    vec3 irradiance    = IrradianceSH(N);
     vec3 diffuseIBL    = irradiance * albedo;
 
     // Specular IBL
     vec3 R             = reflect(-V, N);
-    const float MAX_LOD = 4.0;
-    vec3 prefiltered   = textureLod(prefilterMap, R, roughness * MAX_LOD).rgb;
+    // The last mip holds roughness 1, the level count depends on the IBL quality
+    float maxLod       = float(textureQueryLevels(prefilterMap) - 1);
+    vec3 prefiltered   = textureLod(prefilterMap, R, roughness * maxLod).rgb;
     vec2 brdfLookup    = texture(brdfLUT, vec2(max(dot(N,V),0.0), roughness)).rg;
     vec3 specularIBL   = prefiltered * (F * brdfLookup.x + brdfLookup.y);
 
@@ -147,7 +166,7 @@ void main()
     vec3 ambientLighting = (kD * diffuseIBL + specularIBL) * ao;
 
     // Emissive
-    vec3 emissive = material.emissiveColor;
+    vec3 emissive = EmissiveRoughness.rgb;
 
     // Final
     vec3 colorOut = directLighting + ambientLighting + emissive;
@@ -199,4 +218,19 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
 vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
 {
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}  
\ No newline at end of file
+}  
+
+// Coefficients already hold the cosine lobe and basis constants, matches SphericalHarmonics::evaluate
+vec3 IrradianceSH(vec3 N)
+{
+    vec3 irradiance = irradianceSH[0].rgb
+        + irradianceSH[1].rgb * N.y
+        + irradianceSH[2].rgb * N.z
+        + irradianceSH[3].rgb * N.x
+        + irradianceSH[4].rgb * (N.x * N.y)
+        + irradianceSH[5].rgb * (N.y * N.z)
+        + irradianceSH[6].rgb * (3.0 * N.z * N.z - 1.0)
+        + irradianceSH[7].rgb * (N.x * N.z)
+        + irradianceSH[8].rgb * (N.x * N.x - N.y * N.y);
+    return max(irradiance, vec3(0.0));
+}
@@ -0,0 +1,124 @@
+#version 450 core
+// Prefilters one face of one mip of the specular environment map
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout (binding = 0) uniform samplerCube environmentMap;
+// Storage format of the prefiltered map, see IblBakeParams
+#ifdef PREFILTER_R11F_G11F_B10F
+layout (binding = 0, r11f_g11f_b10f) uniform writeonly imageCube prefilterMip;
+#else
+layout (binding = 0, rgba16f) uniform writeonly imageCube prefilterMip;
+#endif
+
+uniform float roughness;
+uniform int mipSize;
+uniform int environmentSize;
+uniform int sampleCount;
+uniform int face;
+
+const float PI = 3.14159265359;
+
+float RadicalInverse_VdC(uint bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10; // Divide by 2^32
+}
+
+vec2 Hammersley(uint i, uint N)
+{
+    return vec2(float(i) / float(N), RadicalInverse_VdC(i));
+}
+
+vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0 * PI * Xi.x;
+    float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a * a - 1.0) * Xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+    // Spherical to Cartesian
+    vec3 H;
+    H.x = cos(phi) * sinTheta;
+    H.y = sin(phi) * sinTheta;
+    H.z = cosTheta;
+
+    // From tangent space to world space
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    vec3 sampleVec = tangent * H.x + bitangent * H.y + N * H.z;
+    return normalize(sampleVec);
+}
+
+float DistributionGGX(float NdotH, float roughness)
+{
+    float a      = roughness*roughness;
+    float a2     = a*a;
+    float NdotH2 = NdotH*NdotH;
+
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    return a2 / (PI * denom * denom);
+}
+
+// Direction through the center of a texel, faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+vec3 CubeDirection(uint face, vec2 uv)
+{
+    switch (face) {
+    case 0u: return vec3( 1.0, -uv.y, -uv.x);
+    case 1u: return vec3(-1.0, -uv.y,  uv.x);
+    case 2u: return vec3( uv.x,  1.0,  uv.y);
+    case 3u: return vec3( uv.x, -1.0, -uv.y);
+    case 4u: return vec3( uv.x, -uv.y,  1.0);
+    default: return vec3(-uv.x, -uv.y, -1.0);
+    }
+}
+
+void main()
+{
+    ivec3 texel = ivec3(gl_GlobalInvocationID.xy, face);
+    if (texel.x >= mipSize || texel.y >= mipSize) {
+        return;
+    }
+
+    vec2 uv = (vec2(texel.xy) + 0.5) / float(mipSize) * 2.0 - 1.0;
+    vec3 N = normalize(CubeDirection(uint(face), uv));
+    vec3 V = N;
+
+    // A mirror lobe is a plain downsample, read the environment mip matching this resolution
+    if (sampleCount <= 1) {
+        float lod = log2(float(environmentSize) / float(mipSize));
+        imageStore(prefilterMip, texel, vec4(textureLod(environmentMap, N, lod).rgb, 1.0));
+        return;
+    }
+
+    // Filtered importance sampling: each sample reads the environment mip whose texels
+    // cover the solid angle of the sample, so few samples are needed without fireflies
+    float saTexel = 4.0 * PI / (6.0 * float(environmentSize) * float(environmentSize));
+    uint count = uint(sampleCount);
+    vec3 prefilteredColor = vec3(0.0);
+    float totalWeight = 0.0;
+    for (uint i = 0u; i < count; ++i)
+    {
+        vec2 Xi = Hammersley(i, count);
+        vec3 H = ImportanceSampleGGX(Xi, N, roughness);
+        vec3 L = reflect(-V, H);
+
+        float NdotL = dot(N, L);
+        if (NdotL > 0.0)
+        {
+            // N == V, so the pdf D * NdotH / (4 * VdotH) reduces to D / 4
+            float NdotH = max(dot(N, H), 0.0);
+            float pdf = DistributionGGX(NdotH, roughness) * 0.25 + 0.0001;
+            float saSample = 1.0 / (float(count) * pdf + 0.0001);
+            float mipLevel = max(0.5 * log2(saSample / saTexel) + 1.0, 0.0);
+
+            prefilteredColor += textureLod(environmentMap, L, mipLevel).rgb * NdotL;
+            totalWeight += NdotL;
+        }
+    }
+    imageStore(prefilterMip, texel, vec4(prefilteredColor / max(totalWeight, 0.0001), 1.0));
+}
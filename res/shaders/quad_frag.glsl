@@ -6,25 +6,20 @@ in vec2 TexCoords;
 uniform sampler2D screenTexture; 
 uniform sampler2D ssaoTexture;   
 
-uniform bool useSSAO; // Flag to enable/disable SSAO
+// USE_SSAO is a shader feature define, set by the renderer
 
 void main()
 {
     vec4 sceneColor = texture(screenTexture, TexCoords).rgba;
-    float ssao = texture(ssaoTexture, TexCoords).r;
    
-    vec4 finalColor = vec4(0.0);
-    if (useSSAO) {
-        if(ssao != 0) {
-            // Apply SSAO effect
-            finalColor = vec4(sceneColor.rgb * ssao, sceneColor.a);
-        } else {
-            // If SSAO is zero, just use the scene color
-            finalColor = sceneColor;
-        }
-    } else {
-        finalColor = sceneColor;
+    vec4 finalColor = sceneColor;
+#ifdef USE_SSAO
+    float ssao = texture(ssaoTexture, TexCoords).r;
+    if(ssao != 0) {
+        // Apply SSAO effect
+        finalColor = vec4(sceneColor.rgb * ssao, sceneColor.a);
     }
+#endif
 
     FragColor = finalColor;
     
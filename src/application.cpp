@@ -6,6 +6,12 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <future>
 #include <magic_enum.hpp>
+#include <chrono>
+#include <algorithm>
+#include "program_cache.h"
+#include "texture_loader.h"
+#include "resource_cache.h"
+#include "skybox.h"
 
 Application::Application()
 {
@@ -22,12 +28,17 @@ Application::~Application()
 
 void Application::run()
 {
+	bool firstFrame = true;
 	while (!glfwWindowShouldClose(m_renderer->getWindow()))
 	{
 		deltaTime();
 
 		updateUI();
 		m_renderer->update();
+		if (firstFrame) {
+			printStartupReport();
+			firstFrame = false;
+		}
 		glfwPollEvents();
 
 		processInput(m_deltaTime);
@@ -37,6 +48,8 @@ void Application::run()
 
 void Application::init()
 {
+	m_startTime = std::chrono::steady_clock::now();
+
 	m_renderer->lightDir = glm::vec3(0.0f, 1.0f, -1.0f);
 	m_renderer->setLightColor(glm::vec3(1.0f, 1.0f, 1.0f));
 	m_renderer->setCamera(&m_camera);
@@ -47,21 +60,11 @@ void Application::init()
 	setCallbacks();
 
 	// Create default meshes
-	std::shared_ptr<Mesh> m_sphereMesh = std::make_shared<Mesh>();
-	m_sphereMesh->loadSphere(1.0f, 50);
-	m_meshes[MeshType::Sphere] = m_sphereMesh;
-
-	std::shared_ptr<Mesh> m_cubeMesh = std::make_shared<Mesh>();
-	m_cubeMesh->loadCube(1.0f);
-	m_meshes[MeshType::Cube] = m_cubeMesh;
-
-	std::shared_ptr<Mesh> m_suzanneMesh = std::make_shared<Mesh>();
-	m_suzanneMesh->loadModel(RES_DIR"/models/suzanne.obj");
-	m_meshes[MeshType::Suzanne] = m_suzanneMesh;
-
-	std::shared_ptr<Mesh> m_kabutoMesh = std::make_shared<Mesh>();
-	m_kabutoMesh->loadModel(RES_DIR"/models/kabuto.obj");
-	m_meshes[MeshType::Kabuto] = m_kabutoMesh;
+	ResourceCache& resources = ResourceCache::get();
+	m_meshes[MeshType::Sphere] = resources.getSphere(1.0f, 50);
+	m_meshes[MeshType::Cube] = resources.getCube(1.0f);
+	m_meshes[MeshType::Suzanne] = resources.getModel(RES_DIR"/models/suzanne.obj");
+	m_meshes[MeshType::Kabuto] = resources.getModel(RES_DIR"/models/kabuto.obj");
 
 	// Create default material
 	std::shared_ptr<Material> basicMat = std::make_shared<Material>();
@@ -75,32 +78,23 @@ void Application::init()
 	// Create textured materials
 	std::shared_ptr<Material> lightgoldMat = std::make_shared<Material>();
 	lightgoldMat->shader = m_renderer->getPBRShader();
-	lightgoldMat->albedoMap = std::make_shared<Texture>(RES_DIR"/textures/materials/lightgold_albedo.png");
-	lightgoldMat->normalMap = std::make_shared<Texture>(RES_DIR"/textures/materials/lightgold_normal-ogl.png");
-	lightgoldMat->metallicMap = std::make_shared<Texture>(RES_DIR"/textures/materials/lightgold_metallic.png");
-	lightgoldMat->roughnessMap = std::make_shared<Texture>(RES_DIR"/textures/materials/lightgold_roughness.png");
-	//lightgoldMat->aoMap = std::make_shared<Texture>(RES_DIR"/textures/materials/scuffed-plastic-ao.png");
+	lightgoldMat->albedoMap = resources.getTexture(RES_DIR"/textures/materials/lightgold_albedo.png");
+	lightgoldMat->normalMap = resources.getTexture(RES_DIR"/textures/materials/lightgold_normal-ogl.png");
+	lightgoldMat->loadOrmMap(RES_DIR"/textures/materials/lightgold_metallic.png", RES_DIR"/textures/materials/lightgold_roughness.png", "");
 	lightgoldMat->ao = 0.5f;
 
 	lightgoldMat->useAlbedoMap = true;
 	lightgoldMat->useNormalMap = true;
-	lightgoldMat->useMetalMap = true;
-	lightgoldMat->useRoughMap = true;
-	//lightgoldMat->useAoMap = true;
 
 	std::shared_ptr<Material> scuffedPlasticMat = std::make_shared<Material>();
 	scuffedPlasticMat->shader = m_renderer->getPBRShader();
-	scuffedPlasticMat->albedoMap = std::make_shared<Texture>(RES_DIR"/textures/materials/scuffed-plastic-alb.png");
-	scuffedPlasticMat->normalMap = std::make_shared<Texture>(RES_DIR"/textures/materials/scuffed-plastic-normal.png");
-	scuffedPlasticMat->metallicMap = std::make_shared<Texture>(RES_DIR"/textures/materials/scuffed-plastic-metal.png");
-	scuffedPlasticMat->roughnessMap = std::make_shared<Texture>(RES_DIR"/textures/materials/scuffed-plastic-rough.png");
-	scuffedPlasticMat->aoMap = std::make_shared<Texture>(RES_DIR"/textures/materials/scuffed-plastic-ao.png");
+	scuffedPlasticMat->albedoMap = resources.getTexture(RES_DIR"/textures/materials/scuffed-plastic-alb.png");
+	scuffedPlasticMat->normalMap = resources.getTexture(RES_DIR"/textures/materials/scuffed-plastic-normal.png");
+	scuffedPlasticMat->loadOrmMap(RES_DIR"/textures/materials/scuffed-plastic-metal.png", RES_DIR"/textures/materials/scuffed-plastic-rough.png",
+		RES_DIR"/textures/materials/scuffed-plastic-ao.png");
 
 	scuffedPlasticMat->useAlbedoMap = true;
 	scuffedPlasticMat->useNormalMap = true;
-	scuffedPlasticMat->useMetalMap = true;
-	scuffedPlasticMat->useRoughMap = true;
-	scuffedPlasticMat->useAoMap = true;
 
 	// Set materials to map
 	m_materials["Default"] = basicMat;
@@ -110,16 +104,19 @@ void Application::init()
 	// Kabuto material
 	Material m_kabutoMaterial;
 	m_kabutoMaterial.shader = m_renderer->getPBRShader();
-	m_kabutoMaterial.albedoMap = std::make_shared<Texture>(RES_DIR"/textures/materials/kabuto/Material_baseColor.png");
-	m_kabutoMaterial.normalMap = std::make_shared<Texture>(RES_DIR"/textures/materials/kabuto/Material_normal.png");
-	m_kabutoMaterial.metallicMap = std::make_shared<Texture>(RES_DIR"/textures/materials/kabuto/Material_metallic.png");
-	m_kabutoMaterial.roughnessMap = std::make_shared<Texture>(RES_DIR"/textures/materials/kabuto/Material_roughness.png");
+	m_kabutoMaterial.albedoMap = resources.getTexture(RES_DIR"/textures/materials/kabuto/Material_baseColor.png");
+	m_kabutoMaterial.normalMap = resources.getTexture(RES_DIR"/textures/materials/kabuto/Material_normal.png");
+	m_kabutoMaterial.loadOrmMap(RES_DIR"/textures/materials/kabuto/Material_metallic.png", RES_DIR"/textures/materials/kabuto/Material_roughness.png", "");
 	m_kabutoMaterial.ao = 0.5f;
 
 	m_kabutoMaterial.useAlbedoMap = true;
 	m_kabutoMaterial.useNormalMap = true;
-	m_kabutoMaterial.useMetalMap = true;
-	m_kabutoMaterial.useRoughMap = true;
+
+	// Submit the PBR variants now so they compile while the scene and environment load
+	for (const auto& [name, material] : m_materials) {
+		material->shader->prepare(material->getFeatures());
+	}
+	m_kabutoMaterial.shader->prepare(m_kabutoMaterial.getFeatures());
 
 	std::unique_ptr<Scene> scene = std::make_unique<Scene>();
 	/*scene->addEntity(std::make_shared<Entity>(m_meshes[MeshType::SPHERE], basicMat, glm::vec3(-5.0f, 0.0f, 0.0f)));
@@ -136,16 +133,35 @@ void Application::init()
 	basicMat.roughness = 0.0f;
 	scene->addEntity(std::make_shared<Entity>(m_meshes[MeshType::SPHERE], basicMat, glm::vec3(5.0f, 0.0f, 0.0f)));*/
 
-	scene->addEntity(std::make_shared<Entity>(m_meshes[MeshType::Kabuto], m_kabutoMaterial, glm::vec3(5.0f, 0.0f, 0.0f), "Kabuto"));
-	scene->addEntity(std::make_shared<Entity>(m_meshes[MeshType::Sphere], *basicMat, glm::vec3(0.0f, 0.0f, 0.0f), "Sphere"));
-	scene->addEntity(std::make_shared<Entity>(m_meshes[MeshType::Cube], *basicMat, glm::vec3(-5.0f, 0.0f, 0.0f), "Cube"));
-	std::shared_ptr<Entity> plane = std::make_shared<Entity>(m_meshes[MeshType::Cube], *basicMat, glm::vec3(0.0f, -2.0f, 0.0f), "Plane");
-	plane->scale = glm::vec3(20.0f, 0.1f, 20.0f);
-	scene->addEntity(plane);
+	for (const auto& [name, material] : m_materials) {
+		m_materialIds[name] = scene->addMaterial(*material);
+	}
+	MaterialId kabutoMaterial = scene->addMaterial(m_kabutoMaterial);
+
+	scene->createEntity(m_meshes[MeshType::Kabuto], kabutoMaterial, glm::vec3(5.0f, 0.0f, 0.0f), "Kabuto");
+	scene->createEntity(m_meshes[MeshType::Sphere], m_materialIds["Default"], glm::vec3(0.0f, 0.0f, 0.0f), "Sphere");
+	scene->createEntity(m_meshes[MeshType::Cube], m_materialIds["Default"], glm::vec3(-5.0f, 0.0f, 0.0f), "Cube");
+	EntityHandle plane = scene->createEntity(m_meshes[MeshType::Cube], m_materialIds["Default"], glm::vec3(0.0f, -2.0f, 0.0f), "Plane");
+	scene->setScale(plane, glm::vec3(20.0f, 0.1f, 20.0f));
 
 	m_renderer->setCurrentScene(std::move(scene));
 }
 
+void Application::printStartupReport()
+{
+	// Compare runs with an empty and a filled program cache to see the cold and warm startup cost.
+	// Printed after the first frame so the programs it binds have finished and their compile time is in.
+	m_startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+	const ProgramCacheStats& programStats = ProgramCache::getStats();
+	std::cout << "Startup took " << m_startupMs << " ms (" << (programStats.compiled == 0 ? "warm" : "cold") << "), "
+		<< programStats.loaded << " programs loaded from cache in " << programStats.loadMs << " ms, "
+		<< programStats.compiled << " compiled in " << programStats.compileMs << " ms";
+	if (programStats.rejected > 0) {
+		std::cout << ", " << programStats.rejected << " cached binaries rejected";
+	}
+	std::cout << std::endl;
+}
+
 void Application::shutdown()
 {
 	m_renderer->shutdown();
@@ -171,6 +187,9 @@ void Application::initUI()
 	for (const auto& name : meshTypeNames) {
 		m_meshTypes.push_back(name.data());
 	}
+	for (const auto& name : magic_enum::enum_names<IblQuality>()) {
+		m_iblQualities.push_back(name.data());
+	}
 }
 
 void Application::updateUI()
@@ -190,6 +209,33 @@ void Application::updateUI()
 	ImGui::Begin("Info");
 	ImGui::Text("%.3f ms/frame", 1000.0f / ImGui::GetIO().Framerate);
 	ImGui::Text("%.1f FPS", ImGui::GetIO().Framerate);
+	const RenderQueue& renderQueue = m_renderer->getRenderQueue();
+	ImGui::Text("%zu instances in %zu draw calls", renderQueue.getInstanceCount(), renderQueue.getDrawCallCount());
+	ImGui::Checkbox("Multi-draw indirect", &m_renderer->useMultiDrawIndirect);
+	const CullingStats& culling = m_renderer->getCullingStats();
+	ImGui::Checkbox("Frustum culling", &m_renderer->useFrustumCulling);
+	ImGui::Text("Camera: %zu visible, %zu culled", culling.cameraVisible, culling.entityCount - culling.cameraVisible);
+	ImGui::Text("Shadow: %zu visible, %zu culled", culling.lightVisible, culling.entityCount - culling.lightVisible);
+	const ProgramCacheStats& programStats = ProgramCache::getStats();
+	ImGui::Text("Startup: %.1f ms", m_startupMs);
+	ImGui::Text("Programs: %u cached (%.1f ms), %u compiled (%.1f ms)",
+		programStats.loaded, programStats.loadMs, programStats.compiled, programStats.compileMs);
+	ImGui::Text("Textures loading: %zu", TextureLoader::get().getPendingCount());
+	ResourceCache& resources = ResourceCache::get();
+	resources.evictExpired();
+	ResourceStats resourceStats = resources.getStats();
+	ImGui::Text("Resources: %zu textures (%.1f MB), %zu meshes (%.1f MB), %zu shaders",
+		resourceStats.textureCount, resourceStats.textureBytes / (1024.0 * 1024.0),
+		resourceStats.meshCount, resourceStats.meshBytes / (1024.0 * 1024.0), resourceStats.shaderCount);
+	ImGui::Text("Mesh arena: %.1f MB", resourceStats.meshArenaBytes / (1024.0 * 1024.0));
+	ImGui::Text("Resource cache: %zu hits, %zu misses", resourceStats.hits, resourceStats.misses);
+	if (Skybox* skybox = currentScene->getSkybox()) {
+		const IblBakeParams& iblParams = skybox->getBakeParams();
+		ImGui::Text("IBL memory: %.1f MB (environment %d %s, prefilter %d %s)",
+			skybox->getMemoryBytes() / (1024.0 * 1024.0),
+			iblParams.environmentSize, IblBakeParams::getFormatName(iblParams.environmentFormat),
+			iblParams.prefilterSize, IblBakeParams::getFormatName(iblParams.prefilterFormat));
+	}
 	ImGui::End();
 
 	ImGui::Begin("Post-Processing");
@@ -198,74 +244,125 @@ void Application::updateUI()
 	ImGui::SetNextItemWidth(100.0f);
 	ImGui::SliderFloat("Exposure", &m_renderer->exposure, 0.01f, 1.0f);
 	ImGui::Text("Light Direction");
-	if (ImGui::InputFloat3("Light Direction", glm::value_ptr(m_renderer->lightDir))) {
-		m_renderer->updateLighting();
+	ImGui::InputFloat3("Light Direction", glm::value_ptr(m_renderer->lightDir));
+	if (Skybox* skybox = currentScene->getSkybox()) {
+		static char environmentPath[256];
+		if (environmentPath[0] == '\0') {
+			snprintf(environmentPath, sizeof(environmentPath), "%s", skybox->getEnvironmentPath().c_str());
+		}
+		ImGui::Text("Environment");
+		ImGui::InputText("HDR", environmentPath, IM_ARRAYSIZE(environmentPath));
+		if (ImGui::Button("Load environment")) {
+			currentScene->setEnvironment(environmentPath);
+		}
+		int iblQuality = static_cast<int>(skybox->getQuality());
+		ImGui::SetNextItemWidth(100.0f);
+		if (ImGui::Combo("IBL quality", &iblQuality, m_iblQualities.data(), static_cast<int>(m_iblQualities.size()))) {
+			skybox->setQuality(magic_enum::enum_value<IblQuality>(iblQuality));
+		}
+		ImGui::SetNextItemWidth(100.0f);
+		ImGui::SliderFloat("IBL budget (ms)", &skybox->rebuildBudgetMs, 0.5f, 16.0f);
+		if (skybox->isRebuilding()) {
+			ImGui::Text("Rebuilding IBL: %zu steps left", skybox->getPendingSteps());
+		}
 	}
 	ImGui::End();
 
 	ImGui::Begin("Scene Editor");
 
-	// Entity list
-	for (auto& entity : currentScene->getEntities()) {
-		if (ImGui::TreeNode(entity->getName().c_str())) {
+	// Entity list, deletion waits for the end of the loop since it reorders the packed arrays
+	EntityHandle deletedEntity;
+	for (size_t i = 0; i < currentScene->getEntityCount(); ++i) {
+		EntityHandle entity = currentScene->getHandle(i);
+		if (ImGui::TreeNode(currentScene->getName(entity).c_str())) {
 			if (ImGui::TreeNode("Material")) {
-				Material& material = entity->getMaterial();
+				// Edited on a copy, see below
+				MaterialId materialId = currentScene->getMaterialId(entity);
+				Material material = currentScene->getMaterial(materialId);
+				bool changed = false;
 				if (!material.useAlbedoMap) {
-					ImGui::ColorEdit3("Albedo", glm::value_ptr(material.albedo));
+					changed |= ImGui::ColorEdit3("Albedo", glm::value_ptr(material.albedo));
 				}
 				else {
 					ImGui::Text("Albedo Map");
 				}
 				if (!material.useMetalMap) {
-					ImGui::SliderFloat("Metallic", &material.metallic, 0.0f, 1.0f);
+					changed |= ImGui::SliderFloat("Metallic", &material.metallic, 0.0f, 1.0f);
 				}
 				else {
 					ImGui::Text("Metallic Map");
 				}
 				if (!material.useRoughMap) {
-					ImGui::SliderFloat("Roughness", &material.roughness, 0.0f, 1.0f);
+					changed |= ImGui::SliderFloat("Roughness", &material.roughness, 0.0f, 1.0f);
 				}
 				else {
 					ImGui::Text("Roughness Map");
 				}
 				if (!material.useAoMap) {
-					ImGui::SliderFloat("AO", &material.ao, 0.0f, 1.0f);
+					changed |= ImGui::SliderFloat("AO", &material.ao, 0.0f, 1.0f);
 				}
 				else {
 					ImGui::Text("AO Map");
 				}
-				ImGui::ColorEdit3("Emissive Color", glm::value_ptr(material.emissiveColor), ImGuiColorEditFlags_HDR);
+				changed |= ImGui::ColorEdit3("Emissive Color", glm::value_ptr(material.emissiveColor), ImGuiColorEditFlags_HDR);
+
+				if (changed) {
+					// Copy on write: other entities using the material and the presets new entities
+					// are created with keep theirs, the edited entity gets its own from here on
+					const std::vector<MaterialId>& materialIds = currentScene->getMaterialIds();
+					bool isShared = std::count(materialIds.begin(), materialIds.end(), materialId) > 1;
+					for (const auto& [name, presetId] : m_materialIds) {
+						isShared |= presetId == materialId;
+					}
+					if (isShared) {
+						currentScene->setMaterialId(entity, currentScene->addMaterial(material));
+					}
+					else {
+						currentScene->getMaterial(materialId) = material;
+					}
+				}
 				ImGui::TreePop();
 			}
 			if (ImGui::TreeNode("Transform")) {
-				ImGui::InputFloat3("Position", glm::value_ptr(entity->position));
-				ImGui::InputFloat3("Rotation", glm::value_ptr(entity->rotation));
-				ImGui::InputFloat3("Scale", glm::value_ptr(entity->scale));
+				// Edited on copies, the setters mark the cached matrices dirty
+				glm::vec3 position = currentScene->getPosition(entity);
+				glm::vec3 rotation = currentScene->getRotation(entity);
+				glm::vec3 scale = currentScene->getScale(entity);
+				if (ImGui::InputFloat3("Position", glm::value_ptr(position))) {
+					currentScene->setPosition(entity, position);
+				}
+				if (ImGui::InputFloat3("Rotation", glm::value_ptr(rotation))) {
+					currentScene->setRotation(entity, rotation);
+				}
+				if (ImGui::InputFloat3("Scale", glm::value_ptr(scale))) {
+					currentScene->setScale(entity, scale);
+				}
 
 				if (ImGui::Button("Reset Transform")) {
-					entity->position = glm::vec3(0.0f);
-					entity->rotation = glm::vec3(0.0f);
-					entity->scale = glm::vec3(1.0f);
+					currentScene->setPosition(entity, glm::vec3(0.0f));
+					currentScene->setRotation(entity, glm::vec3(0.0f));
+					currentScene->setScale(entity, glm::vec3(1.0f));
 				}
 				ImGui::TreePop();
 			}
 			
 			if (cam->hasTarget() && cam->getTarget() == entity) {
 				if (ImGui::Button("Unfollow")) {
-					cam->setTarget(nullptr);
+					cam->setTarget(nullptr, EntityHandle());
 				}
 			}
 			else {
 				if (ImGui::Button("Follow")) {
-					cam->setTarget(entity);
+					cam->setTarget(currentScene.get(), entity);
 				}
 			}
 			if (ImGui::Button("Delete Entity")) {
-				currentScene->deleteEntity(entity);
+				deletedEntity = entity;
 			}
 			ImGui::TreePop();
 		}
 	}
+	currentScene->destroyEntity(deletedEntity);
 
 
 	bool& isAddingEntity = currentScene->getIsAddingEntity();
@@ -288,12 +385,12 @@ void Application::updateUI()
 
 		// Combo box for materials using the unordered_map
 		std::vector<const char*> materialNames;
-		for (const auto& [key, value] : m_materials) {
+		for (const auto& [key, value] : m_materialIds) {
 			materialNames.push_back(key.c_str());
 		}
 		static int materialIndex = 0;
 		ImGui::Combo("Material", &materialIndex, materialNames.data(), static_cast<int>(materialNames.size()));
-		Material material = *m_materials[materialNames[materialIndex]];
+		MaterialId material = m_materialIds[materialNames[materialIndex]];
 
 		// Text input for entity name
 		static char entityName[32];
@@ -311,8 +408,8 @@ void Application::updateUI()
 			bool nameExists;
 			do {
 				nameExists = false;
-				for (const auto& entity : currentScene->getEntities()) {
-					if (entity->getName() == entityName) {
+				for (size_t i = 0; i < currentScene->getEntityCount(); ++i) {
+					if (currentScene->getName(currentScene->getHandle(i)) == entityName) {
 						// Generate a new name with a numeric suffix
 						snprintf(entityName, sizeof(entityName), "%s%d", baseName.c_str(), suffix);
 						++suffix;
@@ -322,7 +419,7 @@ void Application::updateUI()
 				}
 			} while (nameExists);
 
-			currentScene->addEntity(std::make_shared<Entity>(m_meshes[selectedMeshType], material, newPosition, entityName));
+			currentScene->createEntity(m_meshes[selectedMeshType], material, newPosition, entityName);
 			isAddingEntity = false;
 			newPosition = glm::vec3(0.0f);
 
@@ -0,0 +1,186 @@
+#include "brdf_lut.h"
+#include "half_float.h"
+#include "mapped_file.h"
+#include "glad/glad.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+	const char BRDF_LUT_MAGIC[4] = { 'B', 'R', 'D', 'F' };
+	const uint32_t BRDF_LUT_VERSION = 1;
+
+	struct BrdfLutHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t size;
+		uint32_t sampleCount;
+	};
+
+	const float PI = 3.14159265358979f;
+
+	float radicalInverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return static_cast<float>(bits) * 2.3283064365386963e-10f;
+	}
+
+	// Same geometry term as the direct lighting in pbr_frag.glsl
+	float geometrySchlickGGX(float NdotV, float roughness)
+	{
+		float r = roughness + 1.0f;
+		float k = (r * r) / 8.0f;
+		return NdotV / (NdotV * (1.0f - k) + k);
+	}
+}
+
+void BrdfLut::integrate(float NdotV, float roughness, int sampleCount, float& scale, float& bias)
+{
+	// Accumulate in double, the sum runs over thousands of samples
+	double A = 0.0;
+	double B = 0.0;
+	const float Vx = std::sqrt(1.0f - NdotV * NdotV);
+	const float Vz = NdotV;
+	const float a = roughness * roughness;
+
+	for (int i = 0; i < sampleCount; ++i) {
+		// Hammersley point, importance sampled GGX half vector around N = +Z
+		float Xi0 = static_cast<float>(i) / static_cast<float>(sampleCount);
+		float Xi1 = radicalInverse(static_cast<uint32_t>(i));
+		float phi = 2.0f * PI * Xi0;
+		float cosTheta = std::sqrt((1.0f - Xi1) / (1.0f + (a * a - 1.0f) * Xi1));
+		float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+		float Hx = std::cos(phi) * sinTheta;
+		float Hy = std::sin(phi) * sinTheta;
+		float Hz = cosTheta;
+
+		float VdotH = Vx * Hx + Vz * Hz;
+		float Lz = 2.0f * VdotH * Hz - Vz;
+
+		float NdotL = std::max(Lz, 0.0f);
+		float NdotH = std::max(Hz, 0.0f);
+		VdotH = std::max(VdotH, 0.0f);
+		if (NdotL > 0.0f) {
+			float G = geometrySchlickGGX(NdotL, roughness) * geometrySchlickGGX(NdotV, roughness);
+			float G_Vis = (G * VdotH) / (NdotH * NdotV);
+			float Fc = std::pow(1.0f - VdotH, 5.0f);
+
+			A += (1.0f - Fc) * G_Vis;
+			B += Fc * G_Vis;
+		}
+	}
+	scale = static_cast<float>(A / sampleCount);
+	bias = static_cast<float>(B / sampleCount);
+}
+
+std::vector<float> BrdfLut::compute(int size, int sampleCount)
+{
+	std::vector<float> table(static_cast<size_t>(size) * size * 2);
+	auto computeRows = [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; ++y) {
+			float roughness = (y + 0.5f) / size;
+			for (int x = 0; x < size; ++x) {
+				float NdotV = (x + 0.5f) / size;
+				float* texel = &table[(static_cast<size_t>(y) * size + x) * 2];
+				integrate(NdotV, roughness, sampleCount, texel[0], texel[1]);
+			}
+		}
+	};
+
+	unsigned int coreCount = std::thread::hardware_concurrency();
+	int threadCount = std::clamp(static_cast<int>(coreCount), 1, size);
+	int rowsPerThread = (size + threadCount - 1) / threadCount;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadCount; ++i) {
+		int rowBegin = i * rowsPerThread;
+		int rowEnd = std::min(size, rowBegin + rowsPerThread);
+		threads.emplace_back(computeRows, rowBegin, rowEnd);
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return table;
+}
+
+bool BrdfLut::write(const std::string& path, int size, int sampleCount, const std::vector<float>& table)
+{
+	BrdfLutHeader header;
+	std::memcpy(header.magic, BRDF_LUT_MAGIC, sizeof(BRDF_LUT_MAGIC));
+	header.version = BRDF_LUT_VERSION;
+	header.size = static_cast<uint32_t>(size);
+	header.sampleCount = static_cast<uint32_t>(sampleCount);
+
+	std::vector<uint16_t> halves(table.size());
+	for (size_t i = 0; i < table.size(); ++i) {
+		halves[i] = floatToHalf(table[i]);
+	}
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Could not write BRDF LUT " << path << std::endl;
+		return false;
+	}
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(halves.data()), halves.size() * sizeof(uint16_t));
+	return static_cast<bool>(out);
+}
+
+bool BrdfLut::read(const std::string& path, int& size, std::vector<uint16_t>& halves)
+{
+	MappedFile file;
+	if (!file.open(path) || file.size() < sizeof(BrdfLutHeader)) {
+		return false;
+	}
+
+	BrdfLutHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+	size_t dataSize = static_cast<size_t>(header.size) * header.size * 2 * sizeof(uint16_t);
+	if (std::memcmp(header.magic, BRDF_LUT_MAGIC, sizeof(BRDF_LUT_MAGIC)) != 0 ||
+		header.version != BRDF_LUT_VERSION ||
+		file.size() != sizeof(header) + dataSize) {
+		std::cerr << "Invalid BRDF LUT " << path << std::endl;
+		return false;
+	}
+
+	size = static_cast<int>(header.size);
+	halves.resize(dataSize / sizeof(uint16_t));
+	std::memcpy(halves.data(), file.data() + sizeof(header), dataSize);
+	return true;
+}
+
+unsigned int BrdfLut::getTexture()
+{
+	static unsigned int texture = 0;
+	if (texture) {
+		return texture;
+	}
+
+	int size = 0;
+	std::vector<uint16_t> halves;
+	if (!read(RES_DIR"/textures/brdf_lut.rg16f", size, halves)) {
+		std::cout << "BRDF LUT asset missing, computing it" << std::endl;
+		size = DEFAULT_SIZE;
+		std::vector<float> table = compute(size, FALLBACK_SAMPLE_COUNT);
+		halves.resize(table.size());
+		for (size_t i = 0; i < table.size(); ++i) {
+			halves[i] = floatToHalf(table[i]);
+		}
+	}
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, size, size, 0, GL_RG, GL_HALF_FLOAT, halves.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
@@ -0,0 +1,540 @@
+#include "bvh.h"
+#include "frustum.h"
+#include "job_system.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+	// Centroid bins per split, more gets closer to a full sweep for little gain
+	const int BIN_COUNT = 16;
+	// Trees smaller than this are refit on the calling thread
+	const size_t PARALLEL_REFIT_LEAVES = 8192;
+	const size_t SUBTREES_PER_THREAD = 4;
+
+	AABB merge(const AABB& a, const AABB& b)
+	{
+		return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+
+	float surfaceArea(const AABB& box)
+	{
+		glm::vec3 size = box.max - box.min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool overlaps(const AABB& a, const AABB& b)
+	{
+		return a.min.x <= b.max.x && a.max.x >= b.min.x
+			&& a.min.y <= b.max.y && a.max.y >= b.min.y
+			&& a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+
+	// Slab test, entry distance clamped to the ray origin
+	bool intersectRay(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry)
+	{
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 entries = glm::min(t0, t1);
+		glm::vec3 exits = glm::max(t0, t1);
+		float tEntry = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+		float tExit = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+		entry = tEntry;
+		return tEntry <= tExit;
+	}
+
+	struct Bin {
+		AABB bounds;
+		size_t count = 0;
+	};
+
+	// Split point of order[begin, end) along the cheapest bin boundary, the range is partitioned around it
+	size_t partitionRange(const std::vector<AABB>& boxes, const std::vector<glm::vec3>& centroids,
+		std::vector<uint32_t>& order, size_t begin, size_t end)
+	{
+		glm::vec3 centroidMin = centroids[order[begin]];
+		glm::vec3 centroidMax = centroidMin;
+		for (size_t i = begin + 1; i < end; ++i) {
+			centroidMin = glm::min(centroidMin, centroids[order[i]]);
+			centroidMax = glm::max(centroidMax, centroids[order[i]]);
+		}
+		glm::vec3 extent = centroidMax - centroidMin;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		if (extent[axis] <= 0.0f) {
+			// All centroids in one point, any split is as good as another
+			return (begin + end) / 2;
+		}
+
+		float scale = BIN_COUNT / extent[axis];
+		auto binOf = [&](uint32_t index) {
+			int bin = static_cast<int>((centroids[index][axis] - centroidMin[axis]) * scale);
+			return std::min(bin, BIN_COUNT - 1);
+		};
+
+		Bin bins[BIN_COUNT];
+		for (size_t i = begin; i < end; ++i) {
+			Bin& bin = bins[binOf(order[i])];
+			bin.bounds = bin.count == 0 ? boxes[order[i]] : merge(bin.bounds, boxes[order[i]]);
+			bin.count++;
+		}
+
+		// Sweep from the right to get the area and count of every right side, then from the left
+		float rightCost[BIN_COUNT] = {};
+		AABB rightBounds;
+		size_t rightCount = 0;
+		for (int i = BIN_COUNT - 1; i > 0; --i) {
+			if (bins[i].count > 0) {
+				rightBounds = rightCount == 0 ? bins[i].bounds : merge(rightBounds, bins[i].bounds);
+				rightCount += bins[i].count;
+			}
+			rightCost[i] = rightCount * surfaceArea(rightBounds);
+		}
+
+		int bestSplit = 0;
+		float bestCost = 0.0f;
+		AABB leftBounds;
+		size_t leftCount = 0;
+		for (int i = 1; i < BIN_COUNT; ++i) {
+			if (bins[i - 1].count > 0) {
+				leftBounds = leftCount == 0 ? bins[i - 1].bounds : merge(leftBounds, bins[i - 1].bounds);
+				leftCount += bins[i - 1].count;
+			}
+			if (leftCount == 0 || leftCount == end - begin) {
+				continue;
+			}
+			float cost = leftCount * surfaceArea(leftBounds) + rightCost[i];
+			if (bestSplit == 0 || cost < bestCost) {
+				bestSplit = i;
+				bestCost = cost;
+			}
+		}
+
+		// The first and last bins hold the extreme centroids, so some split always has both sides filled
+		auto middle = std::partition(order.begin() + begin, order.begin() + end,
+			[&](uint32_t index) { return binOf(index) < bestSplit; });
+		return static_cast<size_t>(middle - order.begin());
+	}
+}
+
+void Bvh::clear()
+{
+	m_nodes.clear();
+	m_freeNodes.clear();
+	m_root = NULL_NODE;
+	m_leafCount = 0;
+}
+
+int32_t Bvh::allocateNode()
+{
+	if (!m_freeNodes.empty()) {
+		int32_t index = m_freeNodes.back();
+		m_freeNodes.pop_back();
+		m_nodes[index] = Node();
+		return index;
+	}
+	m_nodes.emplace_back();
+	return static_cast<int32_t>(m_nodes.size() - 1);
+}
+
+void Bvh::freeNode(int32_t index)
+{
+	m_freeNodes.push_back(index);
+}
+
+void Bvh::build(const std::vector<AABB>& boxes, const std::vector<uint32_t>& items, std::vector<int32_t>& proxies)
+{
+	clear();
+	proxies.assign(boxes.size(), NULL_NODE);
+	if (boxes.empty()) {
+		return;
+	}
+
+	std::vector<glm::vec3> centroids(boxes.size());
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+	}
+	std::vector<uint32_t> order(boxes.size());
+	std::iota(order.begin(), order.end(), 0);
+	m_nodes.reserve(boxes.size() * 2 - 1);
+
+	// Ranges left to split, an explicit stack since clustered input can make the tree deep
+	struct Range {
+		size_t begin;
+		size_t end;
+		int32_t parent;
+		bool isLeft;
+	};
+	std::vector<Range> ranges;
+	ranges.push_back({ 0, boxes.size(), NULL_NODE, false });
+	while (!ranges.empty()) {
+		Range range = ranges.back();
+		ranges.pop_back();
+
+		int32_t index = allocateNode();
+		m_nodes[index].parent = range.parent;
+		if (range.parent == NULL_NODE) {
+			m_root = index;
+		}
+		else if (range.isLeft) {
+			m_nodes[range.parent].left = index;
+		}
+		else {
+			m_nodes[range.parent].right = index;
+		}
+
+		if (range.end - range.begin == 1) {
+			uint32_t source = order[range.begin];
+			m_nodes[index].bounds = boxes[source];
+			m_nodes[index].item = items[source];
+			proxies[source] = index;
+			continue;
+		}
+
+		AABB bounds = boxes[order[range.begin]];
+		for (size_t i = range.begin + 1; i < range.end; ++i) {
+			bounds = merge(bounds, boxes[order[i]]);
+		}
+		m_nodes[index].bounds = bounds;
+
+		size_t middle = partitionRange(boxes, centroids, order, range.begin, range.end);
+		ranges.push_back({ middle, range.end, index, false });
+		ranges.push_back({ range.begin, middle, index, true });
+	}
+	m_leafCount = boxes.size();
+}
+
+int32_t Bvh::insert(const AABB& box, uint32_t item)
+{
+	int32_t leaf = allocateNode();
+	m_nodes[leaf].bounds = box;
+	m_nodes[leaf].item = item;
+	m_leafCount++;
+	if (m_root == NULL_NODE) {
+		m_root = leaf;
+		return leaf;
+	}
+
+	// Branch and bound on the area added to the tree, as in Box2D's dynamic tree
+	int32_t index = m_root;
+	while (!m_nodes[index].isLeaf()) {
+		const Node& node = m_nodes[index];
+		float area = surfaceArea(node.bounds);
+		float combinedArea = surfaceArea(merge(node.bounds, box));
+		// Cost of pairing the new leaf with this node, and the least any descent adds to this node
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+
+		auto descentCost = [&](int32_t child) {
+			const AABB& bounds = m_nodes[child].bounds;
+			float grown = surfaceArea(merge(bounds, box));
+			return (m_nodes[child].isLeaf() ? grown : grown - surfaceArea(bounds)) + inheritance;
+		};
+		float leftCost = descentCost(node.left);
+		float rightCost = descentCost(node.right);
+		if (cost < leftCost && cost < rightCost) {
+			break;
+		}
+		index = leftCost < rightCost ? node.left : node.right;
+	}
+
+	int32_t sibling = index;
+	int32_t oldParent = m_nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].bounds = merge(m_nodes[sibling].bounds, box);
+	m_nodes[newParent].left = sibling;
+	m_nodes[newParent].right = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+	if (oldParent == NULL_NODE) {
+		m_root = newParent;
+	}
+	else {
+		if (m_nodes[oldParent].left == sibling) {
+			m_nodes[oldParent].left = newParent;
+		}
+		else {
+			m_nodes[oldParent].right = newParent;
+		}
+		refitAncestors(oldParent);
+	}
+	return leaf;
+}
+
+void Bvh::remove(int32_t proxy)
+{
+	m_leafCount--;
+	if (proxy == m_root) {
+		m_root = NULL_NODE;
+		freeNode(proxy);
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	int32_t parent = m_nodes[proxy].parent;
+	int32_t grandParent = m_nodes[parent].parent;
+	int32_t sibling = m_nodes[parent].left == proxy ? m_nodes[parent].right : m_nodes[parent].left;
+	m_nodes[sibling].parent = grandParent;
+	if (grandParent == NULL_NODE) {
+		m_root = sibling;
+	}
+	else {
+		if (m_nodes[grandParent].left == parent) {
+			m_nodes[grandParent].left = sibling;
+		}
+		else {
+			m_nodes[grandParent].right = sibling;
+		}
+		refitAncestors(grandParent);
+	}
+	freeNode(parent);
+	freeNode(proxy);
+}
+
+void Bvh::update(int32_t proxy, const AABB& box)
+{
+	m_nodes[proxy].bounds = box;
+	refitAncestors(m_nodes[proxy].parent);
+}
+
+void Bvh::setLeafBounds(int32_t proxy, const AABB& box)
+{
+	m_nodes[proxy].bounds = box;
+}
+
+void Bvh::refitAncestors(int32_t index)
+{
+	while (index != NULL_NODE) {
+		Node& node = m_nodes[index];
+		node.bounds = merge(m_nodes[node.left].bounds, m_nodes[node.right].bounds);
+		index = node.parent;
+	}
+}
+
+void Bvh::refit()
+{
+	if (m_root == NULL_NODE) {
+		return;
+	}
+
+	// Cut the top of the tree into enough subtrees to keep every thread busy, refit those
+	// in parallel, then the nodes above them
+	size_t subtreeTarget = m_leafCount >= PARALLEL_REFIT_LEAVES ? JobSystem::get().getThreadCount() * SUBTREES_PER_THREAD : 1;
+	std::vector<int32_t> topNodes;
+	std::vector<int32_t> subtrees = { m_root };
+	while (subtrees.size() < subtreeTarget) {
+		std::vector<int32_t> nextLevel;
+		for (int32_t index : subtrees) {
+			const Node& node = m_nodes[index];
+			if (node.isLeaf()) {
+				nextLevel.push_back(index);
+			}
+			else {
+				topNodes.push_back(index);
+				nextLevel.push_back(node.left);
+				nextLevel.push_back(node.right);
+			}
+		}
+		if (nextLevel.size() == subtrees.size()) {
+			break;
+		}
+		subtrees.swap(nextLevel);
+	}
+
+	JobSystem::get().parallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			refitSubtree(subtrees[i]);
+		}
+	});
+	// Listed level by level, so walking backwards refits children before their parent
+	for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it) {
+		Node& node = m_nodes[*it];
+		node.bounds = merge(m_nodes[node.left].bounds, m_nodes[node.right].bounds);
+	}
+}
+
+void Bvh::refitSubtree(int32_t root)
+{
+	// Internal nodes listed parents first, walked backwards so children are always refit before their parent
+	std::vector<int32_t> internalNodes;
+	std::vector<int32_t> stack = { root };
+	while (!stack.empty()) {
+		int32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = m_nodes[index];
+		if (!node.isLeaf()) {
+			internalNodes.push_back(index);
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+	for (auto it = internalNodes.rbegin(); it != internalNodes.rend(); ++it) {
+		Node& node = m_nodes[*it];
+		node.bounds = merge(m_nodes[node.left].bounds, m_nodes[node.right].bounds);
+	}
+}
+
+void Bvh::collectLeaves(int32_t index, std::vector<uint32_t>& items, std::vector<int32_t>& stack) const
+{
+	size_t base = stack.size();
+	stack.push_back(index);
+	while (stack.size() > base) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (node.isLeaf()) {
+			items.push_back(node.item);
+		}
+		else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const
+{
+	if (m_root == NULL_NODE) {
+		return;
+	}
+
+	std::vector<int32_t> stack = { m_root };
+	while (!stack.empty()) {
+		int32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = m_nodes[index];
+		Frustum::Containment containment = frustum.classify(node.bounds);
+		if (containment == Frustum::Containment::Outside) {
+			continue;
+		}
+		if (node.isLeaf()) {
+			items.push_back(node.item);
+		}
+		else if (containment == Frustum::Containment::Inside) {
+			collectLeaves(index, items, stack);
+		}
+		else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void Bvh::queryBox(const AABB& box, std::vector<uint32_t>& items) const
+{
+	if (m_root == NULL_NODE) {
+		return;
+	}
+
+	std::vector<int32_t> stack = { m_root };
+	while (!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (!overlaps(node.bounds, box)) {
+			continue;
+		}
+		if (node.isLeaf()) {
+			items.push_back(node.item);
+		}
+		else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& item, float& distance) const
+{
+	float entry;
+	glm::vec3 inverseDirection = 1.0f / direction;
+	if (m_root == NULL_NODE || !intersectRay(m_nodes[m_root].bounds, origin, inverseDirection, maxDistance, entry)) {
+		return false;
+	}
+
+	// Nodes with their entry distance, the nearer child is visited first so far subtrees get pruned
+	struct Candidate {
+		int32_t index;
+		float entry;
+	};
+	std::vector<Candidate> stack = { { m_root, entry } };
+	bool hit = false;
+	float nearest = maxDistance;
+	while (!stack.empty()) {
+		Candidate candidate = stack.back();
+		stack.pop_back();
+		if (hit && candidate.entry >= nearest) {
+			continue;
+		}
+
+		const Node& node = m_nodes[candidate.index];
+		if (node.isLeaf()) {
+			hit = true;
+			nearest = candidate.entry;
+			item = node.item;
+			continue;
+		}
+
+		float leftEntry, rightEntry;
+		bool leftHit = intersectRay(m_nodes[node.left].bounds, origin, inverseDirection, nearest, leftEntry);
+		bool rightHit = intersectRay(m_nodes[node.right].bounds, origin, inverseDirection, nearest, rightEntry);
+		if (leftHit && rightHit) {
+			bool leftFirst = leftEntry <= rightEntry;
+			stack.push_back(leftFirst ? Candidate{ node.right, rightEntry } : Candidate{ node.left, leftEntry });
+			stack.push_back(leftFirst ? Candidate{ node.left, leftEntry } : Candidate{ node.right, rightEntry });
+		}
+		else if (leftHit) {
+			stack.push_back({ node.left, leftEntry });
+		}
+		else if (rightHit) {
+			stack.push_back({ node.right, rightEntry });
+		}
+	}
+
+	if (hit) {
+		distance = nearest;
+	}
+	return hit;
+}
+
+float Bvh::getCost() const
+{
+	if (m_root == NULL_NODE || m_nodes[m_root].isLeaf()) {
+		return 0.0f;
+	}
+
+	float rootArea = surfaceArea(m_nodes[m_root].bounds);
+	if (rootArea <= 0.0f) {
+		return 0.0f;
+	}
+	float area = 0.0f;
+	std::vector<int32_t> stack = { m_root };
+	while (!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (!node.isLeaf()) {
+			area += surfaceArea(node.bounds);
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+	return area / rootArea;
+}
+
+int Bvh::getHeight() const
+{
+	if (m_root == NULL_NODE) {
+		return 0;
+	}
+
+	int height = 0;
+	std::vector<std::pair<int32_t, int>> stack = { { m_root, 1 } };
+	while (!stack.empty()) {
+		auto [index, depth] = stack.back();
+		stack.pop_back();
+		height = std::max(height, depth);
+		const Node& node = m_nodes[index];
+		if (!node.isLeaf()) {
+			stack.push_back({ node.left, depth + 1 });
+			stack.push_back({ node.right, depth + 1 });
+		}
+	}
+	return height;
+}
@@ -11,7 +11,6 @@ Camera::Camera(int width, int height, glm::vec3 up, float yaw, float pitch)
 	m_worldUp = up;
 	m_yaw = yaw;
 	m_pitch = pitch;
-	m_target = nullptr;
 	m_position = glm::vec3(0.0f, 0.0f, -5.0f);
 	updateCameraVectors();
 }
@@ -37,11 +36,12 @@ void Camera::setPosition(glm::vec3 position)
 	updateCameraVectors();
 }
 
-void Camera::setTarget(std::shared_ptr<Entity> target)
+void Camera::setTarget(const Scene* scene, EntityHandle target)
 {
+	m_targetScene = scene;
 	m_target = target;
-	if (m_target) {
-		m_distance = glm::clamp(glm::distance(m_position, m_target->position), m_minDistance, m_maxDistance);
+	if (hasTarget()) {
+		m_distance = glm::clamp(glm::distance(m_position, m_targetScene->getPosition(m_target)), m_minDistance, m_maxDistance);
 	}
 	updateCameraVectors();
 }
@@ -55,8 +55,8 @@ void Camera::updateCameraVectors() {
 
 	m_right = glm::normalize(glm::cross(m_forward, m_worldUp));
 	m_up = glm::normalize(glm::cross(m_right, m_forward));
-	if (m_target) {
-		m_position = m_target->position - m_forward * m_distance;
+	if (hasTarget()) {
+		m_position = m_targetScene->getPosition(m_target) - m_forward * m_distance;
 	}
 }
 
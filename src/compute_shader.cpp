@@ -0,0 +1,125 @@
+#include "compute_shader.h"
+#include "glad/glad.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <iostream>
+
+ComputeShader::ComputeShader(const std::string& filePath, const std::vector<std::string>& defines)
+	: m_filePath(filePath)
+{
+	std::ifstream stream(filePath, std::ios::in);
+	if (!stream.is_open()) {
+		std::cerr << "Impossible to open " << filePath << std::endl;
+		return;
+	}
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	std::string source = sstr.str();
+
+	if (!defines.empty()) {
+		size_t versionEnd = 0;
+		if (source.compare(0, 8, "#version") == 0) {
+			versionEnd = source.find('\n');
+			versionEnd = versionEnd == std::string::npos ? source.size() : versionEnd + 1;
+		}
+		std::string defineBlock;
+		for (const std::string& define : defines) {
+			defineBlock += "#define " + define + " 1\n";
+		}
+		defineBlock += "#line 2\n";
+		source = source.substr(0, versionEnd) + defineBlock + source.substr(versionEnd);
+	}
+
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	const char* sourcePointer = source.c_str();
+	glShaderSource(shader, 1, &sourcePointer, NULL);
+	glCompileShader(shader);
+
+	GLint result = GL_FALSE;
+	int infoLogLength = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+	if (infoLogLength > 0) {
+		std::vector<char> message(infoLogLength + 1);
+		glGetShaderInfoLog(shader, infoLogLength, NULL, message.data());
+		std::cout << filePath << ": " << message.data() << std::endl;
+	}
+
+	m_program = glCreateProgram();
+	glAttachShader(m_program, shader);
+	glLinkProgram(m_program);
+	glDetachShader(m_program, shader);
+	glDeleteShader(shader);
+
+	glGetProgramiv(m_program, GL_LINK_STATUS, &result);
+	if (result != GL_TRUE) {
+		glGetProgramiv(m_program, GL_INFO_LOG_LENGTH, &infoLogLength);
+		std::vector<char> message(infoLogLength + 1);
+		glGetProgramInfoLog(m_program, infoLogLength, NULL, message.data());
+		std::cerr << "Could not link " << filePath << ": " << message.data() << std::endl;
+		glDeleteProgram(m_program);
+		m_program = 0;
+		return;
+	}
+
+	GLint localSize[3];
+	glGetProgramiv(m_program, GL_COMPUTE_WORK_GROUP_SIZE, localSize);
+	for (int i = 0; i < 3; ++i) {
+		m_localSize[i] = static_cast<unsigned int>(localSize[i]);
+	}
+
+	GLint uniformCount = 0;
+	glGetProgramInterfaceiv(m_program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+	GLint maxNameLength = 0;
+	glGetProgramInterfaceiv(m_program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+	std::vector<char> name(maxNameLength + 1);
+	const GLenum property = GL_LOCATION;
+	for (GLint i = 0; i < uniformCount; ++i) {
+		GLint location = -1;
+		glGetProgramResourceiv(m_program, GL_UNIFORM, i, 1, &property, 1, NULL, &location);
+		if (location == -1) {
+			continue;
+		}
+		GLsizei length = 0;
+		glGetProgramResourceName(m_program, GL_UNIFORM, i, static_cast<GLsizei>(name.size()), &length, name.data());
+		m_uniforms[UniformId::fromName(std::string_view(name.data(), length)).hash] = location;
+	}
+}
+
+ComputeShader::~ComputeShader()
+{
+	glDeleteProgram(m_program);
+}
+
+void ComputeShader::bind() const
+{
+	glUseProgram(m_program);
+}
+
+void ComputeShader::unbind() const
+{
+	glUseProgram(0);
+}
+
+void ComputeShader::dispatch(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ) const
+{
+	glDispatchCompute((sizeX + m_localSize[0] - 1) / m_localSize[0],
+		(sizeY + m_localSize[1] - 1) / m_localSize[1],
+		(sizeZ + m_localSize[2] - 1) / m_localSize[2]);
+}
+
+int ComputeShader::getUniformLocation(UniformId id) const
+{
+	auto it = m_uniforms.find(id.hash);
+	return it != m_uniforms.end() ? it->second : -1;
+}
+
+void ComputeShader::setUniform1i(UniformId id, int value)
+{
+	glUniform1i(getUniformLocation(id), value);
+}
+
+void ComputeShader::setUniform1f(UniformId id, float value)
+{
+	glUniform1f(getUniformLocation(id), value);
+}
@@ -0,0 +1,178 @@
+#include "frustum.h"
+#include <cmath>
+
+#if defined(__AVX__)
+#define FRUSTUM_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+#if defined(FRUSTUM_AVX)
+	const size_t LANES = 8;
+#elif defined(FRUSTUM_SSE2)
+	const size_t LANES = 4;
+#else
+	const size_t LANES = 1;
+#endif
+
+	// Boxes of one SIMD batch as centers and half extents, one array per component
+	struct BoxLanes {
+		alignas(32) float centerX[LANES];
+		alignas(32) float centerY[LANES];
+		alignas(32) float centerZ[LANES];
+		alignas(32) float extentX[LANES];
+		alignas(32) float extentY[LANES];
+		alignas(32) float extentZ[LANES];
+	};
+
+	void gatherBoxes(const AABB* boxes, BoxLanes& lanes)
+	{
+		for (size_t i = 0; i < LANES; ++i) {
+			lanes.centerX[i] = (boxes[i].min.x + boxes[i].max.x) * 0.5f;
+			lanes.centerY[i] = (boxes[i].min.y + boxes[i].max.y) * 0.5f;
+			lanes.centerZ[i] = (boxes[i].min.z + boxes[i].max.z) * 0.5f;
+			lanes.extentX[i] = (boxes[i].max.x - boxes[i].min.x) * 0.5f;
+			lanes.extentY[i] = (boxes[i].max.y - boxes[i].min.y) * 0.5f;
+			lanes.extentZ[i] = (boxes[i].max.z - boxes[i].min.z) * 0.5f;
+		}
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// Gribb and Hartmann: each plane is the last row plus or minus one of the others.
+	// Left, right, bottom, top, near, far. Unnormalized, the test only looks at the sign.
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	m_planes[0] = rows[3] + rows[0];
+	m_planes[1] = rows[3] - rows[0];
+	m_planes[2] = rows[3] + rows[1];
+	m_planes[3] = rows[3] - rows[1];
+	m_planes[4] = rows[3] + rows[2];
+	m_planes[5] = rows[3] - rows[2];
+}
+
+bool Frustum::isVisible(const AABB& box) const
+{
+	glm::vec3 center = (box.min + box.max) * 0.5f;
+	glm::vec3 extent = (box.max - box.min) * 0.5f;
+	for (const glm::vec4& plane : m_planes) {
+		// Distance of the center against the projected radius of the box on the plane normal
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+		if (distance + radius < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Frustum::Containment Frustum::classify(const AABB& box) const
+{
+	glm::vec3 center = (box.min + box.max) * 0.5f;
+	glm::vec3 extent = (box.max - box.min) * 0.5f;
+	Containment containment = Containment::Inside;
+	for (const glm::vec4& plane : m_planes) {
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+		if (distance + radius < 0.0f) {
+			return Containment::Outside;
+		}
+		if (distance - radius < 0.0f) {
+			containment = Containment::Intersecting;
+		}
+	}
+	return containment;
+}
+
+size_t Frustum::cull(const std::vector<AABB>& boxes, std::vector<uint8_t>& visible) const
+{
+	visible.resize(boxes.size());
+	size_t visibleCount = 0;
+	size_t i = 0;
+
+#if defined(FRUSTUM_AVX)
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	for (int p = 0; p < 6; ++p) {
+		planeX[p] = _mm256_set1_ps(m_planes[p].x);
+		planeY[p] = _mm256_set1_ps(m_planes[p].y);
+		planeZ[p] = _mm256_set1_ps(m_planes[p].z);
+		planeW[p] = _mm256_set1_ps(m_planes[p].w);
+		absX[p] = _mm256_andnot_ps(signMask, planeX[p]);
+		absY[p] = _mm256_andnot_ps(signMask, planeY[p]);
+		absZ[p] = _mm256_andnot_ps(signMask, planeZ[p]);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+	BoxLanes lanes;
+	for (; i + LANES <= boxes.size(); i += LANES) {
+		gatherBoxes(&boxes[i], lanes);
+		__m256 cx = _mm256_load_ps(lanes.centerX);
+		__m256 cy = _mm256_load_ps(lanes.centerY);
+		__m256 cz = _mm256_load_ps(lanes.centerZ);
+		__m256 ex = _mm256_load_ps(lanes.extentX);
+		__m256 ey = _mm256_load_ps(lanes.extentY);
+		__m256 ez = _mm256_load_ps(lanes.extentZ);
+		__m256 outside = zero;
+		for (int p = 0; p < 6; ++p) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)),
+				_mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+		}
+		int mask = _mm256_movemask_ps(outside);
+		for (size_t lane = 0; lane < LANES; ++lane) {
+			uint8_t inside = ((mask >> lane) & 1) == 0;
+			visible[i + lane] = inside;
+			visibleCount += inside;
+		}
+	}
+#elif defined(FRUSTUM_SSE2)
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	for (int p = 0; p < 6; ++p) {
+		planeX[p] = _mm_set1_ps(m_planes[p].x);
+		planeY[p] = _mm_set1_ps(m_planes[p].y);
+		planeZ[p] = _mm_set1_ps(m_planes[p].z);
+		planeW[p] = _mm_set1_ps(m_planes[p].w);
+		absX[p] = _mm_andnot_ps(signMask, planeX[p]);
+		absY[p] = _mm_andnot_ps(signMask, planeY[p]);
+		absZ[p] = _mm_andnot_ps(signMask, planeZ[p]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	BoxLanes lanes;
+	for (; i + LANES <= boxes.size(); i += LANES) {
+		gatherBoxes(&boxes[i], lanes);
+		__m128 cx = _mm_load_ps(lanes.centerX);
+		__m128 cy = _mm_load_ps(lanes.centerY);
+		__m128 cz = _mm_load_ps(lanes.centerZ);
+		__m128 ex = _mm_load_ps(lanes.extentX);
+		__m128 ey = _mm_load_ps(lanes.extentY);
+		__m128 ez = _mm_load_ps(lanes.extentZ);
+		__m128 outside = zero;
+		for (int p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+		int mask = _mm_movemask_ps(outside);
+		for (size_t lane = 0; lane < LANES; ++lane) {
+			uint8_t inside = ((mask >> lane) & 1) == 0;
+			visible[i + lane] = inside;
+			visibleCount += inside;
+		}
+	}
+#endif
+
+	for (; i < boxes.size(); ++i) {
+		visible[i] = isVisible(boxes[i]);
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
@@ -0,0 +1,209 @@
+#include "hdr_image.h"
+#include "half_float.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+	// Largest finite half float, brighter texels are clamped instead of turning into infinity
+	const float MAX_HALF = 65504.0f;
+
+	// New style scanlines start with 2, 2 and the width, then hold each channel run-length encoded
+	bool isRunLengthEncoded(const unsigned char* data, size_t size, size_t offset, int width)
+	{
+		if (width < 8 || width > 0x7FFF || offset + 4 > size) {
+			return false;
+		}
+		const unsigned char* p = data + offset;
+		return p[0] == 2 && p[1] == 2 && (p[2] & 0x80) == 0;
+	}
+
+	// Same conversion as stb_image: mantissa * 2^(exponent - 136)
+	void rgbeToFloat(const unsigned char* rgbe, float* rgb)
+	{
+		if (rgbe[3] == 0) {
+			rgb[0] = rgb[1] = rgb[2] = 0.0f;
+			return;
+		}
+		float scale = std::ldexp(1.0f, rgbe[3] - (128 + 8));
+		for (int i = 0; i < 3; ++i) {
+			rgb[i] = std::min(rgbe[i] * scale, MAX_HALF);
+		}
+	}
+}
+
+bool HdrImage::open(const std::string& path)
+{
+	close();
+	if (!m_file.open(path)) {
+		return false;
+	}
+
+	// Header lines up to an empty one, then the resolution line
+	const char* text = reinterpret_cast<const char*>(m_file.data());
+	size_t size = m_file.size();
+	size_t position = 0;
+	auto readLine = [&](std::string& line) {
+		size_t end = position;
+		while (end < size && text[end] != '\n') {
+			++end;
+		}
+		if (end >= size) {
+			return false;
+		}
+		line.assign(text + position, end - position);
+		position = end + 1;
+		return true;
+	};
+
+	std::string line;
+	if (!readLine(line) || (line != "#?RADIANCE" && line != "#?RGBE")) {
+		close();
+		return false;
+	}
+	bool rgbe = false;
+	while (readLine(line) && !line.empty()) {
+		if (line == "FORMAT=32-bit_rle_rgbe") {
+			rgbe = true;
+		}
+	}
+	// Other orientations are rare, they are left to stb_image
+	int width = 0, height = 0;
+	if (!rgbe || !readLine(line) || std::sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+		close();
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_dataOffset = position;
+	return true;
+}
+
+void HdrImage::close()
+{
+	m_file.close();
+	m_dataOffset = 0;
+	m_width = 0;
+	m_height = 0;
+}
+
+bool HdrImage::findScanlines(std::vector<size_t>& offsets) const
+{
+	const unsigned char* data = m_file.data();
+	size_t size = m_file.size();
+	size_t offset = m_dataOffset;
+
+	offsets.resize(m_height);
+	for (int y = 0; y < m_height; ++y) {
+		offsets[y] = offset;
+		if (!isRunLengthEncoded(data, size, offset, m_width)) {
+			// Flat scanline, 4 bytes per texel
+			offset += static_cast<size_t>(m_width) * 4;
+			if (offset > size) {
+				return false;
+			}
+			continue;
+		}
+		if (((data[offset + 2] << 8) | data[offset + 3]) != m_width) {
+			return false;
+		}
+		offset += 4;
+		// Skip the runs of the 4 channels without decoding them
+		for (int channel = 0; channel < 4; ++channel) {
+			int x = 0;
+			while (x < m_width) {
+				if (offset >= size) {
+					return false;
+				}
+				int count = data[offset++];
+				int length = count > 128 ? count - 128 : count;
+				size_t bytes = count > 128 ? 1 : static_cast<size_t>(count);
+				if (length == 0 || x + length > m_width || offset + bytes > size) {
+					return false;
+				}
+				x += length;
+				offset += bytes;
+			}
+		}
+	}
+	return true;
+}
+
+bool HdrImage::decodeScanline(size_t offset, unsigned char* rgbe) const
+{
+	const unsigned char* data = m_file.data();
+	size_t size = m_file.size();
+	if (!isRunLengthEncoded(data, size, offset, m_width)) {
+		std::memcpy(rgbe, data + offset, static_cast<size_t>(m_width) * 4);
+		return true;
+	}
+
+	// Channels are stored one after the other, interleave them back. Bounds were checked by findScanlines.
+	offset += 4;
+	for (int channel = 0; channel < 4; ++channel) {
+		int x = 0;
+		while (x < m_width) {
+			int count = data[offset++];
+			if (count > 128) {
+				unsigned char value = data[offset++];
+				for (int i = 0; i < count - 128; ++i) {
+					rgbe[(x++) * 4 + channel] = value;
+				}
+			}
+			else {
+				for (int i = 0; i < count; ++i) {
+					rgbe[(x++) * 4 + channel] = data[offset++];
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool HdrImage::decode(uint16_t* dst, SHIrradiance& irradiance) const
+{
+	std::vector<size_t> offsets;
+	if (!isOpen() || !findScanlines(offsets)) {
+		return false;
+	}
+
+	unsigned int coreCount = std::thread::hardware_concurrency();
+	int threadCount = std::clamp(static_cast<int>(coreCount), 1, m_height);
+	std::vector<SHAccumulator> partials(threadCount, SHAccumulator(m_width, m_height));
+	std::vector<std::thread> threads;
+	int rowsPerThread = (m_height + threadCount - 1) / threadCount;
+	for (int i = 0; i < threadCount; ++i) {
+		int rowBegin = i * rowsPerThread;
+		int rowEnd = std::min(m_height, rowBegin + rowsPerThread);
+		threads.emplace_back([this, &offsets, &partials, dst, i, rowBegin, rowEnd]() {
+			std::vector<unsigned char> rgbe(static_cast<size_t>(m_width) * 4);
+			std::vector<float> rgb(static_cast<size_t>(m_width) * 3);
+			for (int row = rowBegin; row < rowEnd; ++row) {
+				// The file stores rows top to bottom
+				decodeScanline(offsets[m_height - 1 - row], rgbe.data());
+				for (int x = 0; x < m_width; ++x) {
+					rgbeToFloat(&rgbe[x * 4], &rgb[x * 3]);
+				}
+				partials[i].addRow(row, rgb.data(), 3);
+
+				uint16_t* out = dst + static_cast<size_t>(row) * m_width * 3;
+				for (int j = 0; j < m_width * 3; ++j) {
+					out[j] = floatToHalf(rgb[j]);
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	// Merged in thread order so the result does not depend on scheduling
+	for (int i = 1; i < threadCount; ++i) {
+		partials[0].merge(partials[i]);
+	}
+	irradiance = partials[0].getIrradiance();
+	return true;
+}
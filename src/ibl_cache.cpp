@@ -0,0 +1,243 @@
+#include "ibl_cache.h"
+#include "mapped_file.h"
+#include "hash.h"
+#include "glad/glad.h"
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+namespace {
+	// Bump the version whenever the layout of the cache file changes
+	const char IBL_CACHE_MAGIC[4] = { 'P', 'B', 'R', 'I' };
+	const uint32_t IBL_CACHE_VERSION = 4;
+
+	/*
+		IBL cache layout:
+		header | irradiance SH | environment faces per level | prefilter faces per level
+	*/
+	struct IblCacheHeader {
+		char magic[4];
+		uint32_t version;
+		IblBakeParams params;
+		uint64_t dataSize;
+	};
+
+	// Client format and type that read back a storage format without conversion
+	struct TexelLayout {
+		GLenum format;
+		GLenum type;
+		size_t bytes;
+	};
+
+	TexelLayout texelLayout(GLenum internalFormat)
+	{
+		switch (internalFormat) {
+		case GL_RGB9_E5: return { GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, 4 };
+		case GL_R11F_G11F_B10F: return { GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, 4 };
+		case GL_RGBA16F: return { GL_RGBA, GL_HALF_FLOAT, 8 };
+		default: return { GL_RGB, GL_HALF_FLOAT, 6 };
+		}
+	}
+
+	size_t cubemapBytes(int size, int levels, size_t texelBytes)
+	{
+		size_t bytes = 0;
+		for (int level = 0; level < levels; ++level) {
+			size_t levelSize = size >> level > 0 ? size >> level : 1;
+			bytes += levelSize * levelSize * 6 * texelBytes;
+		}
+		return bytes;
+	}
+}
+
+IblBakeParams IblBakeParams::forQuality(IblQuality quality)
+{
+	IblBakeParams params;
+	switch (quality) {
+	case IblQuality::Low:
+		params.environmentSize = 512;
+		params.prefilterSize = 128;
+		params.environmentFormat = GL_R11F_G11F_B10F;
+		params.prefilterFormat = GL_R11F_G11F_B10F;
+		break;
+	case IblQuality::Medium:
+		params.environmentSize = 1024;
+		params.prefilterSize = 256;
+		params.environmentFormat = GL_R11F_G11F_B10F;
+		params.prefilterFormat = GL_R11F_G11F_B10F;
+		break;
+	case IblQuality::High:
+		params.environmentSize = 2048;
+		params.prefilterSize = 512;
+		params.environmentFormat = GL_RGB9_E5;
+		params.prefilterFormat = GL_R11F_G11F_B10F;
+		break;
+	case IblQuality::Ultra:
+		params.environmentSize = 2048;
+		params.prefilterSize = 512;
+		params.environmentFormat = GL_RGB16F;
+		params.prefilterFormat = GL_RGBA16F;
+		break;
+	}
+	// One level per roughness step down to 1x1
+	params.prefilterLevels = static_cast<int>(std::log2(params.prefilterSize)) + 1;
+	return params;
+}
+
+int IblBakeParams::getEnvironmentLevels() const
+{
+	return static_cast<int>(std::log2(environmentSize)) + 1;
+}
+
+size_t IblBakeParams::getEnvironmentBytes() const
+{
+	// Drivers pad three channel half floats to four
+	size_t texelBytes = environmentFormat == GL_RGB16F ? 8 : texelLayout(environmentFormat).bytes;
+	return cubemapBytes(environmentSize, getEnvironmentLevels(), texelBytes);
+}
+
+size_t IblBakeParams::getPrefilterBytes() const
+{
+	return cubemapBytes(prefilterSize, prefilterLevels, texelLayout(prefilterFormat).bytes);
+}
+
+const char* IblBakeParams::getFormatName(unsigned int format)
+{
+	switch (format) {
+	case GL_RGB9_E5: return "RGB9_E5";
+	case GL_R11F_G11F_B10F: return "R11F_G11F_B10F";
+	case GL_RGBA16F: return "RGBA16F";
+	case GL_RGB16F: return "RGB16F";
+	default: return "Unknown";
+	}
+}
+
+uint64_t IblCache::computeKey(const std::string& hdrPath, const std::vector<std::string>& bakeShaderPaths, const IblBakeParams& params)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	MappedFile file;
+	if (file.open(hdrPath)) {
+		hashBytes(hash, file.data(), file.size());
+	}
+	else {
+		hashString(hash, hdrPath.c_str());
+	}
+
+	// Editing a bake shader changes the result as much as a different image
+	for (const std::string& path : bakeShaderPaths) {
+		MappedFile shader;
+		if (shader.open(path)) {
+			hashBytes(hash, shader.data(), shader.size());
+		}
+	}
+
+	hashBytes(hash, &params, sizeof(params));
+	return hash;
+}
+
+std::vector<IblCache::Section> IblCache::layout(const IblBakeParams& params, const IblMaps& maps)
+{
+	std::vector<Section> sections;
+	auto addCubemap = [&](unsigned int texture, int size, int levels, GLenum internalFormat) {
+		TexelLayout texel = texelLayout(internalFormat);
+		for (int level = 0; level < levels; ++level) {
+			int levelSize = size >> level > 0 ? size >> level : 1;
+			for (unsigned int face = 0; face < 6; ++face) {
+				sections.push_back({ texture, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, levelSize,
+					texel.format, texel.type, static_cast<size_t>(levelSize) * levelSize * texel.bytes });
+			}
+		}
+	};
+
+	addCubemap(maps.environment, params.environmentSize, params.getEnvironmentLevels(), params.environmentFormat);
+	addCubemap(maps.prefilter, params.prefilterSize, params.prefilterLevels, params.prefilterFormat);
+	return sections;
+}
+
+std::string IblCache::entryPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ibl", static_cast<unsigned long long>(key));
+	return std::string(CACHE_DIR) + "/ibl/" + name;
+}
+
+bool IblCache::open(uint64_t key, const IblBakeParams& params, MappedFile& file, SHIrradiance& irradiance)
+{
+	if (!file.open(entryPath(key)) || file.size() < sizeof(IblCacheHeader) + sizeof(SHIrradiance)) {
+		file.close();
+		return false;
+	}
+
+	size_t dataSize = sizeof(SHIrradiance);
+	for (const Section& section : layout(params, IblMaps{})) {
+		dataSize += section.bytes;
+	}
+
+	IblCacheHeader header;
+	std::memcpy(&header, file.data(), sizeof(IblCacheHeader));
+	if (std::memcmp(header.magic, IBL_CACHE_MAGIC, sizeof(IBL_CACHE_MAGIC)) != 0 ||
+		header.version != IBL_CACHE_VERSION ||
+		std::memcmp(&header.params, &params, sizeof(IblBakeParams)) != 0 ||
+		header.dataSize != dataSize ||
+		file.size() != sizeof(IblCacheHeader) + dataSize) {
+		file.close();
+		return false;
+	}
+
+	std::memcpy(&irradiance, file.data() + sizeof(IblCacheHeader), sizeof(SHIrradiance));
+	return true;
+}
+
+size_t IblCache::getSectionCount(const IblBakeParams& params)
+{
+	return layout(params, IblMaps{}).size();
+}
+
+size_t IblCache::uploadSection(const MappedFile& file, const IblBakeParams& params, const IblMaps& maps, size_t index)
+{
+	std::vector<Section> sections = layout(params, maps);
+	size_t offset = sizeof(IblCacheHeader) + sizeof(SHIrradiance);
+	for (size_t i = 0; i < index; ++i) {
+		offset += sections[i].bytes;
+	}
+
+	// Rows of the small mips are not 4 byte aligned
+	const Section& section = sections[index];
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(section.bindTarget, section.texture);
+	glTexSubImage2D(section.imageTarget, section.level, 0, 0, section.size, section.size, section.format, section.type, file.data() + offset);
+	glBindTexture(section.bindTarget, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return section.bytes;
+}
+
+void IblCache::store(uint64_t key, const IblBakeParams& params, const IblMaps& maps)
+{
+	std::vector<Section> sections = layout(params, maps);
+
+	IblCacheHeader header;
+	std::memcpy(header.magic, IBL_CACHE_MAGIC, sizeof(IBL_CACHE_MAGIC));
+	header.version = IBL_CACHE_VERSION;
+	header.params = params;
+	header.dataSize = sizeof(SHIrradiance);
+	for (const Section& section : sections) {
+		header.dataSize += section.bytes;
+	}
+
+	// Read every section back before writing, the file is written in one go
+	std::vector<char> pixels(static_cast<size_t>(header.dataSize) - sizeof(SHIrradiance));
+	std::vector<FileChunk> chunks = { { &header, sizeof(header) }, { &maps.irradiance, sizeof(SHIrradiance) } };
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	size_t offset = 0;
+	for (const Section& section : sections) {
+		glBindTexture(section.bindTarget, section.texture);
+		glGetTexImage(section.imageTarget, section.level, section.format, section.type, pixels.data() + offset);
+		offset += section.bytes;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	chunks.push_back({ pixels.data(), pixels.size() });
+
+	writeFileAtomic(entryPath(key), chunks);
+}
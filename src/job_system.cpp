@@ -0,0 +1,205 @@
+#include "job_system.h"
+#include <algorithm>
+
+namespace {
+	// Chunks per thread in parallelFor, a few so threads that finish early can steal the rest
+	const size_t CHUNKS_PER_THREAD = 4;
+
+	// Deque owned by the current thread, -1 for threads the job system did not create
+	thread_local int t_queueIndex = -1;
+}
+
+JobSystem& JobSystem::get()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+JobSystem::JobSystem()
+{
+	// The creating thread takes part while it waits, so one worker less than cores
+	unsigned int coreCount = std::thread::hardware_concurrency();
+	unsigned int workerCount = coreCount > 1 ? coreCount - 1 : 1;
+	for (unsigned int i = 0; i <= workerCount; ++i) {
+		m_queues.push_back(std::make_unique<JobQueue>());
+	}
+	t_queueIndex = 0;
+	for (unsigned int i = 1; i <= workerCount; ++i) {
+		m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_sleepCondition.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void JobSystem::workerLoop(unsigned int index)
+{
+	t_queueIndex = static_cast<int>(index);
+	while (true) {
+		Job job;
+		if (findJob(job)) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepCondition.wait(lock, [this]() { return m_stopping || m_queuedCount.load(std::memory_order_acquire) > 0; });
+		if (m_stopping) {
+			return;
+		}
+	}
+}
+
+void JobSystem::push(Job job)
+{
+	// Threads without a deque of their own hand their jobs to the creating thread's
+	JobQueue& queue = *m_queues[t_queueIndex >= 0 ? t_queueIndex : 0];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+	m_queuedCount.fetch_add(1, std::memory_order_release);
+
+	// Taking the lock orders the wake up after a worker's last look at the count
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_sleepCondition.notify_one();
+}
+
+bool JobSystem::pop(unsigned int index, Job& job)
+{
+	// Newest first, its data is most likely still in cache
+	JobQueue& queue = *m_queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty()) {
+		return false;
+	}
+	job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	m_queuedCount.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::steal(unsigned int index, Job& job)
+{
+	// Oldest first, usually the largest piece of work left
+	size_t queueCount = m_queues.size();
+	for (size_t i = 1; i <= queueCount; ++i) {
+		size_t victim = (index + i) % queueCount;
+		if (victim == index && t_queueIndex >= 0) {
+			continue;
+		}
+		JobQueue& queue = *m_queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			m_queuedCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::findJob(Job& job)
+{
+	if (t_queueIndex >= 0 && pop(t_queueIndex, job)) {
+		return true;
+	}
+	return steal(t_queueIndex >= 0 ? t_queueIndex : 0, job);
+}
+
+void JobSystem::execute(Job& job)
+{
+	job.function();
+	if (job.counter) {
+		finish(*job.counter);
+	}
+}
+
+void JobSystem::finish(JobCounter& counter)
+{
+	// Decremented under the lock so a waiter that saw zero can wait for it to be released,
+	// the counter usually lives on the waiter's stack
+	std::vector<std::pair<std::function<void()>, JobCounter*>> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			continuations.swap(counter.m_continuations);
+		}
+	}
+	for (auto& [function, continuationCounter] : continuations) {
+		push({ std::move(function), continuationCounter });
+	}
+}
+
+void JobSystem::run(std::function<void()> job, JobCounter* counter)
+{
+	if (counter) {
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+	push({ std::move(job), counter });
+}
+
+void JobSystem::runAfter(JobCounter& dependency, std::function<void()> job, JobCounter* counter)
+{
+	if (counter) {
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+	{
+		std::lock_guard<std::mutex> lock(dependency.m_mutex);
+		if (dependency.m_pending.load(std::memory_order_acquire) > 0) {
+			dependency.m_continuations.emplace_back(std::move(job), counter);
+			return;
+		}
+	}
+	push({ std::move(job), counter });
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	while (!counter.isDone()) {
+		Job job;
+		if (findJob(job)) {
+			execute(job);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+	// The last job may still be releasing the counter's lock
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& body)
+{
+	if (count == 0) {
+		return;
+	}
+	size_t chunkCount = (count + std::max<size_t>(minChunk, 1) - 1) / std::max<size_t>(minChunk, 1);
+	chunkCount = std::min(chunkCount, static_cast<size_t>(getThreadCount()) * CHUNKS_PER_THREAD);
+	if (chunkCount <= 1) {
+		body(0, count);
+		return;
+	}
+
+	// The calling thread takes the first chunk itself, then helps with the rest
+	size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+	JobCounter counter;
+	for (size_t begin = chunkSize; begin < count; begin += chunkSize) {
+		size_t end = std::min(count, begin + chunkSize);
+		run([&body, begin, end]() { body(begin, end); }, &counter);
+	}
+	body(0, chunkSize);
+	wait(counter);
+}
@@ -0,0 +1,74 @@
+#include "material.h"
+#include "resource_cache.h"
+
+namespace {
+	void bindTexture(const std::shared_ptr<Texture>& texture, int unit)
+	{
+		if (texture) {
+			texture->bind(unit);
+		}
+		else {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+}
+
+void Material::loadOrmMap(const std::string& metallicPath, const std::string& roughnessPath, const std::string& aoPath)
+{
+	ormMap = ResourceCache::get().getOrmTexture(aoPath, roughnessPath, metallicPath);
+	useOrmMap = true;
+	useMetalMap = !metallicPath.empty();
+	useRoughMap = !roughnessPath.empty();
+	useAoMap = !aoPath.empty();
+}
+
+void Material::bind() const
+{
+	shader->bind(getFeatures());
+
+	// Sampler units are fixed with layout(binding) in the shader, only the textures change
+	if (useAlbedoMap) {
+		bindTexture(albedoMap, ALBEDO_TEXTURE_UNIT);
+	}
+	if (useNormalMap) {
+		bindTexture(normalMap, NORMAL_TEXTURE_UNIT);
+	}
+	if (useOrmMap) {
+		bindTexture(ormMap, ORM_TEXTURE_UNIT);
+		return;
+	}
+	if (useMetalMap) {
+		bindTexture(metallicMap, METAL_TEXTURE_UNIT);
+	}
+	if (useRoughMap) {
+		bindTexture(roughnessMap, ROUGH_TEXTURE_UNIT);
+	}
+	if (useAoMap) {
+		bindTexture(aoMap, AO_TEXTURE_UNIT);
+	}
+}
+
+uint32_t Material::getFeatures() const
+{
+	uint32_t features = 0;
+	if (useAlbedoMap) {
+		features |= ALBEDO_MAP_FEATURE;
+	}
+	if (useNormalMap) {
+		features |= NORMAL_MAP_FEATURE;
+	}
+	if (useMetalMap) {
+		features |= METAL_MAP_FEATURE;
+	}
+	if (useRoughMap) {
+		features |= ROUGH_MAP_FEATURE;
+	}
+	if (useAoMap) {
+		features |= AO_MAP_FEATURE;
+	}
+	if (useOrmMap) {
+		features |= ORM_MAP_FEATURE;
+	}
+	return features;
+}
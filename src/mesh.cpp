@@ -1,7 +1,34 @@
 #include "mesh.h"
+#include "mapped_file.h"
+#include "mesh_arena.h"
 #include "glad/glad.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include <iostream>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+	// Bump the version whenever the layout of the cache file changes
+	const char MESH_CACHE_MAGIC[4] = { 'P', 'B', 'R', 'M' };
+	const uint32_t MESH_CACHE_VERSION = 2;
+
+	/*
+		Binary mesh cache layout:
+		header | submesh table | vertices | indices
+	*/
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize; // sizeof(Vertex) when written, rejects caches from another vertex layout
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t submeshCount;
+		AABB bounds;
+	};
+
+	static_assert(sizeof(unsigned int) == sizeof(uint32_t), "Mesh cache stores 32-bit indices");
+}
 
 Mesh::Mesh()
 {
@@ -14,59 +41,113 @@ Mesh::Mesh(const std::vector<Vertex>& verts, const std::vector<unsigned int>& in
 
 Mesh::~Mesh()
 {
+	if (isSetup) {
+		MeshArena::get().release(m_baseVertex, m_vertexCount, m_firstIndex, m_indexCount);
+	}
 }
 
 void Mesh::setupMesh()
 {
-	// Generate buffers
-	glGenVertexArrays(1, &m_vao);
-	glGenBuffers(1, &m_vbo);
-	glGenBuffers(1, &m_ibo);
-
-	glBindVertexArray(m_vao);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex), &m_vertices[0], GL_STATIC_DRAW);
+	if (m_submeshes.empty()) {
+		m_submeshes.push_back(SubMesh{ 0, 0, static_cast<unsigned int>(m_indices.size()), 0 });
+	}
+	computeBounds();
+	uploadBuffers(m_vertices.data(), m_vertices.size(), m_indices.data(), m_indices.size());
+}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), &m_indices[0], GL_STATIC_DRAW);
-	
-	// Position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	glEnableVertexAttribArray(0);
+void Mesh::uploadBuffers(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+	// Reloading into the same mesh gives the old range back first
+	if (isSetup) {
+		MeshArena::get().release(m_baseVertex, m_vertexCount, m_firstIndex, m_indexCount);
+	}
+	MeshArena::get().allocate(vertices, vertexCount, indices, indexCount, m_baseVertex, m_firstIndex);
 
-	// Normal attribute
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_normal));
-	glEnableVertexAttribArray(1);
+	m_indexCount = static_cast<unsigned int>(indexCount);
+	m_vertexCount = vertexCount;
+	isSetup = true;
+}
 
-	// Texture coordinates attribute
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_texCoords));
-	glEnableVertexAttribArray(2);
+void Mesh::computeBounds()
+{
+	if (m_vertices.empty()) {
+		m_bounds = AABB();
+		return;
+	}
 
-	// Tangent attribute
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_tangent));
-	glEnableVertexAttribArray(3);
+	m_bounds.min = m_vertices[0].m_position;
+	m_bounds.max = m_vertices[0].m_position;
+	for (const Vertex& vertex : m_vertices) {
+		m_bounds.min = glm::min(m_bounds.min, vertex.m_position);
+		m_bounds.max = glm::max(m_bounds.max, vertex.m_position);
+	}
+}
 
-	// Bitangent attribute
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_bitangent));
-	glEnableVertexAttribArray(4);
 
-	// Unbind the VAO
+void Mesh::draw()
+{
+	if (!isSetup)
+	{
+		setupMesh();
+	}
+	// Every submesh lives in the shared arena, only the offsets change between draws
+	MeshArena::get().bind();
+	for (const SubMesh& submesh : m_submeshes)
+	{
+		glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indexCount, GL_UNSIGNED_INT,
+			(void*)((m_firstIndex + submesh.firstIndex) * sizeof(unsigned int)), m_baseVertex + submesh.baseVertex);
+	}
 	glBindVertexArray(0);
-
-	isSetup = true;
 }
 
+void Mesh::drawInstanced(unsigned int instanceCount, unsigned int baseInstance)
+{
+	if (!isSetup)
+	{
+		setupMesh();
+	}
+	MeshArena::get().bind();
+	for (const SubMesh& submesh : m_submeshes)
+	{
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, submesh.indexCount, GL_UNSIGNED_INT,
+			(void*)((m_firstIndex + submesh.firstIndex) * sizeof(unsigned int)), instanceCount,
+			m_baseVertex + submesh.baseVertex, baseInstance);
+	}
+	glBindVertexArray(0);
+}
 
+void Mesh::appendDrawCommands(std::vector<DrawElementsIndirectCommand>& commands, unsigned int instanceCount, unsigned int baseInstance)
+{
+	if (!isSetup)
+	{
+		setupMesh();
+	}
+	for (const SubMesh& submesh : m_submeshes)
+	{
+		DrawElementsIndirectCommand command;
+		command.count = submesh.indexCount;
+		command.instanceCount = instanceCount;
+		command.firstIndex = m_firstIndex + submesh.firstIndex;
+		command.baseVertex = static_cast<int>(m_baseVertex + submesh.baseVertex);
+		command.baseInstance = baseInstance;
+		commands.push_back(command);
+	}
+}
 
-void Mesh::draw()
+void Mesh::drawSubMesh(unsigned int index)
 {
 	if (!isSetup)
 	{
 		setupMesh();
 	}
-	glBindVertexArray(m_vao);
-	glDrawElements(GL_TRIANGLES, m_indices.size(), GL_UNSIGNED_INT, 0);
+	if (index >= m_submeshes.size())
+	{
+		return;
+	}
+	const SubMesh& submesh = m_submeshes[index];
+	MeshArena::get().bind();
+	glDrawElementsBaseVertex(GL_TRIANGLES, submesh.indexCount, GL_UNSIGNED_INT,
+		(void*)((m_firstIndex + submesh.firstIndex) * sizeof(unsigned int)), m_baseVertex + submesh.baseVertex);
 	glBindVertexArray(0);
 }
 
@@ -244,6 +325,11 @@ void Mesh::loadCube(float size)
 
 void Mesh::loadModel(const std::string& path)
 {
+	std::string cachePath = path + ".meshcache";
+	if (loadCache(path, cachePath)) {
+		return;
+	}
+
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_CalcTangentSpace);
 
@@ -252,8 +338,89 @@ void Mesh::loadModel(const std::string& path)
 		return;
 	}
 
+	m_vertices.clear();
+	m_indices.clear();
+	m_submeshes.clear();
+
+	// Reserve the whole arena up front, models with thousands of parts would otherwise reallocate constantly
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		vertexCount += scene->mMeshes[i]->mNumVertices;
+		indexCount += scene->mMeshes[i]->mNumFaces * 3;
+	}
+	m_vertices.reserve(vertexCount);
+	m_indices.reserve(indexCount);
+
 	processNode(scene->mRootNode, scene);
 	setupMesh();
+	writeCache(cachePath);
+}
+
+bool Mesh::loadCache(const std::string& sourcePath, const std::string& cachePath)
+{
+	std::error_code error;
+	if (!std::filesystem::exists(cachePath, error)) {
+		return false;
+	}
+
+	// Re-import when the source model was modified after the cache was written
+	if (std::filesystem::last_write_time(sourcePath, error) > std::filesystem::last_write_time(cachePath, error)) {
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(cachePath) || file.size() < sizeof(MeshCacheHeader)) {
+		return false;
+	}
+
+	MeshCacheHeader header;
+	std::memcpy(&header, file.data(), sizeof(MeshCacheHeader));
+	if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+		header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(Vertex)) {
+		std::cout << "Mesh cache out of date: " << cachePath << std::endl;
+		return false;
+	}
+
+	size_t submeshOffset = sizeof(MeshCacheHeader);
+	size_t vertexOffset = submeshOffset + header.submeshCount * sizeof(SubMesh);
+	size_t indexOffset = vertexOffset + static_cast<size_t>(header.vertexCount) * sizeof(Vertex);
+	size_t fileEnd = indexOffset + static_cast<size_t>(header.indexCount) * sizeof(unsigned int);
+	if (fileEnd != file.size()) {
+		std::cerr << "Mesh cache is corrupted: " << cachePath << std::endl;
+		return false;
+	}
+
+	const SubMesh* submeshes = reinterpret_cast<const SubMesh*>(file.data() + submeshOffset);
+	m_submeshes.assign(submeshes, submeshes + header.submeshCount);
+	m_bounds = header.bounds;
+
+	// Upload straight from the mapped file, the vertex data is never copied on the CPU
+	uploadBuffers(reinterpret_cast<const Vertex*>(file.data() + vertexOffset), header.vertexCount,
+		reinterpret_cast<const unsigned int*>(file.data() + indexOffset), header.indexCount);
+
+	std::cout << "Loaded mesh cache: " << cachePath << " (" << header.vertexCount << " vertices, " << header.indexCount << " indices)" << std::endl;
+	return true;
+}
+
+void Mesh::writeCache(const std::string& cachePath) const
+{
+	MeshCacheHeader header;
+	std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.vertexCount = static_cast<uint32_t>(m_vertices.size());
+	header.indexCount = static_cast<uint32_t>(m_indices.size());
+	header.submeshCount = static_cast<uint32_t>(m_submeshes.size());
+	header.bounds = m_bounds;
+
+	writeFileAtomic(cachePath, {
+		{ &header, sizeof(MeshCacheHeader) },
+		{ m_submeshes.data(), m_submeshes.size() * sizeof(SubMesh) },
+		{ m_vertices.data(), m_vertices.size() * sizeof(Vertex) },
+		{ m_indices.data(), m_indices.size() * sizeof(unsigned int) },
+	});
 }
 
 
@@ -273,8 +440,11 @@ void Mesh::processNode(aiNode* node, const aiScene* scene)
 
 void Mesh::processMesh(aiMesh* mesh, const aiScene* scene)
 {
-	m_vertices.clear();
-	m_indices.clear();
+	// Append this part to the shared vertex/index arena, indices stay relative to the submesh base vertex
+	SubMesh submesh;
+	submesh.baseVertex = static_cast<unsigned int>(m_vertices.size());
+	submesh.firstIndex = static_cast<unsigned int>(m_indices.size());
+	submesh.materialIndex = mesh->mMaterialIndex;
 
 	// Vertices
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -329,4 +499,7 @@ void Mesh::processMesh(aiMesh* mesh, const aiScene* scene)
 			m_indices.push_back(face.mIndices[j]);
 		}
 	}
+
+	submesh.indexCount = static_cast<unsigned int>(m_indices.size()) - submesh.firstIndex;
+	m_submeshes.push_back(submesh);
 }
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "mesh_arena.h"
+#include "glad/glad.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+	const size_t INITIAL_VERTEX_CAPACITY = 1 << 16;
+	const size_t INITIAL_INDEX_CAPACITY = 1 << 18;
+	const size_t INITIAL_INSTANCE_CAPACITY = 1 << 10;
+
+	// Move the used part of a buffer into a bigger one, the old buffer is deleted
+	unsigned int growBuffer(unsigned int buffer, size_t usedBytes, size_t newBytes)
+	{
+		unsigned int newBuffer;
+		glGenBuffers(1, &newBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+
+		if (buffer && usedBytes > 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		if (buffer)
+		{
+			glDeleteBuffers(1, &buffer);
+		}
+		return newBuffer;
+	}
+}
+
+MeshArena& MeshArena::get()
+{
+	static MeshArena arena;
+	return arena;
+}
+
+MeshArena::MeshArena()
+{
+	glGenVertexArrays(1, &m_vao);
+
+	m_vertexCapacity = INITIAL_VERTEX_CAPACITY;
+	m_vbo = growBuffer(0, 0, m_vertexCapacity * sizeof(Vertex));
+
+	m_indexCapacity = INITIAL_INDEX_CAPACITY;
+	m_ibo = growBuffer(0, 0, m_indexCapacity * sizeof(unsigned int));
+
+	setupVertexAttributes();
+	reserveInstanceIds(INITIAL_INSTANCE_CAPACITY);
+}
+
+MeshArena::~MeshArena()
+{
+	// The arena lives until exit, the context may already be gone so the buffers are left to the driver
+}
+
+void MeshArena::allocate(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+	unsigned int& baseVertex, unsigned int& firstIndex)
+{
+	size_t vertexOffset = m_vertexCount;
+	size_t indexOffset = m_indexCount;
+	if (vertexCount > 0)
+	{
+		takeRange(m_freeVertices, vertexCount, vertexOffset);
+	}
+	if (indexCount > 0)
+	{
+		takeRange(m_freeIndices, indexCount, indexOffset);
+	}
+	size_t vertexEnd = std::max(m_vertexCount, vertexOffset + vertexCount);
+	size_t indexEnd = std::max(m_indexCount, indexOffset + indexCount);
+
+	if (vertexEnd > m_vertexCapacity || indexEnd > m_indexCapacity)
+	{
+		if (vertexEnd > m_vertexCapacity)
+		{
+			size_t capacity = std::max(vertexEnd, m_vertexCapacity * 2);
+			m_vbo = growBuffer(m_vbo, m_vertexCount * sizeof(Vertex), capacity * sizeof(Vertex));
+			m_vertexCapacity = capacity;
+		}
+		if (indexEnd > m_indexCapacity)
+		{
+			size_t capacity = std::max(indexEnd, m_indexCapacity * 2);
+			m_ibo = growBuffer(m_ibo, m_indexCount * sizeof(unsigned int), capacity * sizeof(unsigned int));
+			m_indexCapacity = capacity;
+		}
+		setupVertexAttributes();
+	}
+
+	baseVertex = static_cast<unsigned int>(vertexOffset);
+	firstIndex = static_cast<unsigned int>(indexOffset);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * sizeof(Vertex), vertexCount * sizeof(Vertex), vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindVertexArray(m_vao);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset * sizeof(unsigned int), indexCount * sizeof(unsigned int), indices);
+	glBindVertexArray(0);
+
+	m_vertexCount = vertexEnd;
+	m_indexCount = indexEnd;
+}
+
+void MeshArena::release(unsigned int baseVertex, size_t vertexCount, unsigned int firstIndex, size_t indexCount)
+{
+	// Bookkeeping only, meshes can be destroyed after the context is gone
+	returnRange(m_freeVertices, m_vertexCount, baseVertex, vertexCount);
+	returnRange(m_freeIndices, m_indexCount, firstIndex, indexCount);
+}
+
+bool MeshArena::takeRange(std::vector<Range>& freeRanges, size_t count, size_t& offset)
+{
+	for (size_t i = 0; i < freeRanges.size(); ++i)
+	{
+		Range& range = freeRanges[i];
+		if (range.count < count)
+		{
+			continue;
+		}
+		offset = range.offset;
+		range.offset += count;
+		range.count -= count;
+		if (range.count == 0)
+		{
+			freeRanges.erase(freeRanges.begin() + i);
+		}
+		return true;
+	}
+	return false;
+}
+
+void MeshArena::returnRange(std::vector<Range>& freeRanges, size_t& end, size_t offset, size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+		[](const Range& range, size_t value) { return range.offset < value; });
+	auto it = freeRanges.insert(next, Range{ offset, count });
+	if (it + 1 != freeRanges.end() && it->offset + it->count == (it + 1)->offset)
+	{
+		it->count += (it + 1)->count;
+		freeRanges.erase(it + 1);
+	}
+	if (it != freeRanges.begin() && (it - 1)->offset + (it - 1)->count == it->offset)
+	{
+		(it - 1)->count += it->count;
+		freeRanges.erase(it);
+	}
+
+	// Free space at the end is simply unused again
+	if (!freeRanges.empty() && freeRanges.back().offset + freeRanges.back().count == end)
+	{
+		end = freeRanges.back().offset;
+		freeRanges.pop_back();
+	}
+}
+
+void MeshArena::reserveInstanceIds(size_t count)
+{
+	if (count <= m_instanceIdCapacity)
+	{
+		return;
+	}
+
+	m_instanceIdCapacity = std::max(count, m_instanceIdCapacity * 2);
+	std::vector<unsigned int> ids(m_instanceIdCapacity);
+	for (size_t i = 0; i < ids.size(); ++i)
+	{
+		ids[i] = static_cast<unsigned int>(i);
+	}
+
+	if (m_instanceIdBuffer == 0)
+	{
+		glGenBuffers(1, &m_instanceIdBuffer);
+	}
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(unsigned int), ids.data(), GL_STATIC_DRAW);
+
+	// Instance index attribute
+	glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+	glEnableVertexAttribArray(5);
+	glVertexAttribDivisor(5, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshArena::bind() const
+{
+	glBindVertexArray(m_vao);
+}
+
+void MeshArena::setupVertexAttributes()
+{
+	glBindVertexArray(m_vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+
+	// Position attribute
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	// Normal attribute
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_normal));
+	glEnableVertexAttribArray(1);
+
+	// Texture coordinates attribute
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_texCoords));
+	glEnableVertexAttribArray(2);
+
+	// Tangent attribute
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_tangent));
+	glEnableVertexAttribArray(3);
+
+	// Bitangent attribute
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_bitangent));
+	glEnableVertexAttribArray(4);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
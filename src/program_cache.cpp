@@ -0,0 +1,136 @@
+#include "program_cache.h"
+#include "mapped_file.h"
+#include "hash.h"
+#include "glad/glad.h"
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+namespace {
+	// Bump the version whenever the layout of the cache file changes
+	const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'B', 'R', 'P' };
+	const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+	/*
+		Program binary cache layout:
+		header | binary
+	*/
+	struct ProgramCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t length;
+	};
+}
+
+ProgramCacheStats ProgramCache::s_stats;
+
+uint64_t ProgramCache::computeKey(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	hashBytes(hash, vertexSource.data(), vertexSource.size() + 1);
+	hashBytes(hash, fragmentSource.data(), fragmentSource.size() + 1);
+
+	// Binaries are only valid for the driver that produced them
+	hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+	hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+	hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+	return hash;
+}
+
+bool ProgramCache::isSupported()
+{
+	static int formatCount = -1;
+	if (formatCount < 0) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	}
+	return formatCount > 0;
+}
+
+std::string ProgramCache::entryPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return std::string(CACHE_DIR) + "/shaders/" + name;
+}
+
+unsigned int ProgramCache::load(uint64_t key)
+{
+	if (!isSupported()) {
+		return 0;
+	}
+
+	MappedFile file;
+	if (!file.open(entryPath(key)) || file.size() < sizeof(ProgramCacheHeader)) {
+		return 0;
+	}
+
+	ProgramCacheHeader header;
+	std::memcpy(&header, file.data(), sizeof(ProgramCacheHeader));
+	if (std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 ||
+		header.version != PROGRAM_CACHE_VERSION ||
+		file.size() != sizeof(ProgramCacheHeader) + header.length) {
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, file.data() + sizeof(ProgramCacheHeader), header.length);
+
+	// The driver may refuse a binary at any time, the caller then compiles from source
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glDeleteProgram(program);
+		s_stats.rejected++;
+		return 0;
+	}
+	return program;
+}
+
+void ProgramCache::prepare(unsigned int program)
+{
+	if (isSupported()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+void ProgramCache::store(uint64_t key, unsigned int program)
+{
+	if (!isSupported() || program == 0) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	ProgramCacheHeader header;
+	std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.format = format;
+	header.length = static_cast<uint32_t>(length);
+
+	writeFileAtomic(entryPath(key), { { &header, sizeof(header) }, { binary.data(), static_cast<size_t>(length) } });
+}
+
+void ProgramCache::recordLoad(double ms)
+{
+	s_stats.loaded++;
+	s_stats.loadMs += ms;
+}
+
+void ProgramCache::recordCompileSubmit()
+{
+	s_stats.compiled++;
+}
+
+void ProgramCache::recordCompile(double ms)
+{
+	s_stats.compileMs += ms;
+}
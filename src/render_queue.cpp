@@ -0,0 +1,232 @@
+#include "render_queue.h"
+#include "mesh_arena.h"
+#include "job_system.h"
+#include "glad/glad.h"
+#include <algorithm>
+
+namespace {
+	// Binding point of the InstanceBuffer block in basic_vert.glsl and depth_vert.glsl
+	const unsigned int INSTANCE_BUFFER_BINDING = 0;
+
+	// Orphan last frame's storage so the upload does not wait for the GPU to finish with it
+	void streamBuffer(GLenum target, unsigned int& buffer, size_t& capacity, const void* data, size_t size)
+	{
+		if (buffer == 0)
+		{
+			glGenBuffers(1, &buffer);
+		}
+
+		if (size > capacity)
+		{
+			capacity = std::max(size, capacity * 2);
+		}
+
+		glBindBuffer(target, buffer);
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		if (size > 0)
+		{
+			glBufferSubData(target, 0, size, data);
+		}
+		glBindBuffer(target, 0);
+	}
+
+	// Below this many entities a single std::sort is faster than spreading it out
+	const size_t PARALLEL_SORT_SIZE = 8192;
+	const size_t INSTANCE_JOB_SIZE = 1024;
+
+	// One sorted run per thread, then neighbouring runs merged pairwise until one is left
+	template<typename Compare>
+	void parallelSort(std::vector<uint32_t>& values, Compare compare)
+	{
+		size_t runCount = JobSystem::get().getThreadCount();
+		if (values.size() < PARALLEL_SORT_SIZE || runCount < 2) {
+			std::sort(values.begin(), values.end(), compare);
+			return;
+		}
+
+		size_t size = values.size();
+		size_t runSize = (size + runCount - 1) / runCount;
+		JobSystem::get().parallelFor(runCount, 1, [&](size_t begin, size_t end) {
+			for (size_t run = begin; run < end; ++run) {
+				size_t first = std::min(size, run * runSize);
+				size_t last = std::min(size, first + runSize);
+				std::sort(values.begin() + first, values.begin() + last, compare);
+			}
+		});
+		for (size_t width = runSize; width < size; width *= 2) {
+			size_t pairCount = (size + 2 * width - 1) / (2 * width);
+			JobSystem::get().parallelFor(pairCount, 1, [&](size_t begin, size_t end) {
+				for (size_t pair = begin; pair < end; ++pair) {
+					size_t first = pair * 2 * width;
+					size_t middle = std::min(size, first + width);
+					size_t last = std::min(size, first + 2 * width);
+					std::inplace_merge(values.begin() + first, values.begin() + middle, values.begin() + last, compare);
+				}
+			});
+		}
+	}
+}
+
+RenderQueue::RenderQueue()
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+	if (m_instanceBuffer)
+	{
+		glDeleteBuffers(1, &m_instanceBuffer);
+	}
+	if (m_indirectBuffer)
+	{
+		glDeleteBuffers(1, &m_indirectBuffer);
+	}
+}
+
+void RenderQueue::prepare(const Scene& scene, const std::vector<uint8_t>* visible)
+{
+	m_sortedEntities.clear();
+	m_instances.clear();
+	m_batches.clear();
+
+	const std::vector<MeshId>& meshIds = scene.getMeshIds();
+	const std::vector<MaterialId>& materialIds = scene.getMaterialIds();
+	for (uint32_t i = 0; i < scene.getEntityCount(); ++i)
+	{
+		if ((!visible || (*visible)[i]) && scene.getMesh(meshIds[i]) && scene.getMaterial(materialIds[i]).shader)
+		{
+			m_sortedEntities.push_back(i);
+		}
+	}
+
+	// Sort by material bindings first so every mesh using them ends up in one multi-draw group
+	parallelSort(m_sortedEntities, [&](uint32_t a, uint32_t b) {
+		if (materialIds[a] != materialIds[b]) {
+			auto keyA = scene.getMaterial(materialIds[a]).bindingKey();
+			auto keyB = scene.getMaterial(materialIds[b]).bindingKey();
+			if (keyA != keyB) {
+				return keyA < keyB;
+			}
+		}
+		return meshIds[a] < meshIds[b];
+	});
+
+	for (size_t i = 0; i < m_sortedEntities.size(); ++i)
+	{
+		uint32_t entity = m_sortedEntities[i];
+		Mesh* mesh = scene.getMesh(meshIds[entity]);
+		const Material& material = scene.getMaterial(materialIds[entity]);
+
+		if (m_batches.empty() || m_batches.back().mesh != mesh || m_batches.back().material->bindingKey() != material.bindingKey())
+		{
+			RenderBatch batch;
+			batch.mesh = mesh;
+			batch.material = &material;
+			batch.firstInstance = static_cast<unsigned int>(i);
+			m_batches.push_back(batch);
+		}
+		m_batches.back().instanceCount++;
+	}
+
+	// Instances only depend on their own entity, filled in parallel
+	const std::vector<glm::mat4>& worldMatrices = scene.getWorldMatrices();
+	const std::vector<glm::mat4>& normalMatrices = scene.getNormalMatrices();
+	m_instances.resize(m_sortedEntities.size());
+	JobSystem::get().parallelFor(m_sortedEntities.size(), INSTANCE_JOB_SIZE, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			uint32_t entity = m_sortedEntities[i];
+			const Material& material = scene.getMaterial(materialIds[entity]);
+			InstanceData& instance = m_instances[i];
+			instance.model = worldMatrices[entity];
+			instance.normalMatrix = normalMatrices[entity];
+			instance.albedoMetallic = glm::vec4(material.albedo, material.metallic);
+			instance.emissiveRoughness = glm::vec4(material.emissiveColor, material.roughness);
+			instance.ao = glm::vec4(material.ao, 0.0f, 0.0f, 0.0f);
+		}
+	});
+}
+
+void RenderQueue::submit()
+{
+	m_groups.clear();
+	m_commands.clear();
+
+	// One indirect command per submesh of each batch, baseInstance points at the batch instances.
+	// Meshes upload their geometry on first use, so this stays on the GL thread.
+	for (RenderBatch& batch : m_batches)
+	{
+		batch.firstCommand = static_cast<unsigned int>(m_commands.size());
+		batch.mesh->appendDrawCommands(m_commands, batch.instanceCount, batch.firstInstance);
+		batch.commandCount = static_cast<unsigned int>(m_commands.size()) - batch.firstCommand;
+
+		if (m_groups.empty() || m_groups.back().material->bindingKey() != batch.material->bindingKey())
+		{
+			DrawGroup group;
+			group.material = batch.material;
+			group.firstCommand = batch.firstCommand;
+			m_groups.push_back(group);
+		}
+		m_groups.back().commandCount += batch.commandCount;
+	}
+
+	MeshArena::get().reserveInstanceIds(m_instances.size());
+
+	streamBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer, m_instanceCapacity,
+		m_instances.data(), m_instances.size() * sizeof(InstanceData));
+	streamBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer, m_indirectCapacity,
+		m_commands.data(), m_commands.size() * sizeof(DrawElementsIndirectCommand));
+}
+
+size_t RenderQueue::getDrawCallCount() const
+{
+	return m_mode == SubmissionMode::MultiDrawIndirect ? m_groups.size() : m_commands.size();
+}
+
+void RenderQueue::drawGeometry()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, m_instanceBuffer);
+
+	if (m_mode == SubmissionMode::MultiDrawIndirect)
+	{
+		// Textures are still bound per material, so each set of material bindings is one multi-draw
+		MeshArena::get().bind();
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		for (const DrawGroup& group : m_groups)
+		{
+			group.material->bind();
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				(void*)(group.firstCommand * sizeof(DrawElementsIndirectCommand)), group.commandCount, 0);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+		return;
+	}
+
+	for (const RenderBatch& batch : m_batches)
+	{
+		batch.material->bind();
+		batch.mesh->drawInstanced(batch.instanceCount, batch.firstInstance);
+	}
+}
+
+void RenderQueue::drawDepth()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, m_instanceBuffer);
+
+	if (m_mode == SubmissionMode::MultiDrawIndirect)
+	{
+		// Materials do not matter for depth, every command goes in one call
+		MeshArena::get().bind();
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, static_cast<GLsizei>(m_commands.size()), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+		return;
+	}
+
+	for (const RenderBatch& batch : m_batches)
+	{
+		batch.mesh->drawInstanced(batch.instanceCount, batch.firstInstance);
+	}
+}
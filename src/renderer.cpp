@@ -4,6 +4,16 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <glm/gtc/type_ptr.hpp>
+#include "texture_loader.h"
+#include "resource_cache.h"
+#include "frustum.h"
+#include "job_system.h"
+
+namespace {
+	// Feature bits of the post-process shader variants
+	const uint32_t USE_SSAO_FEATURE = 1 << 0;
+	const uint32_t USE_BLOOM_FEATURE = 1 << 0;
+}
 
 unsigned int Renderer::quadVAO = 0;
 unsigned int Renderer::quadVBO = 0;
@@ -50,6 +60,13 @@ void Renderer::init()
 		return;
 	}
 
+	// Shader storage buffers and multi-draw indirect are core in 4.3
+	if (!GLAD_GL_VERSION_4_3) {
+		std::cerr << "OpenGL 4.3 is required, got " << GLVersion.major << "." << GLVersion.minor << std::endl;
+		glfwTerminate();
+		return;
+	}
+
 	// Enable anti-aliasing
 	glEnable(GL_MULTISAMPLE);
 
@@ -63,22 +80,28 @@ void Renderer::init()
 	// Skybox settings
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-	m_pbrShader = std::make_shared<Shader>(RES_DIR "/shaders/basic_vert.glsl", RES_DIR  "/shaders/pbr_frag.glsl");
-	if (m_pbrShader)
-	{
-		m_pbrShader->bind();
-		m_pbrShader->setUniform3f("lightDir", lightDir.x, lightDir.y, lightDir.z);
-		m_pbrShader->setUniform3f("lightColor", m_lightColor.x, m_lightColor.y, m_lightColor.z);
-		glm::vec3 camPos = m_camera->getPosition();
-		m_pbrShader->setUniform3f("camPos", camPos.x, camPos.y, camPos.z);
+	// Let the driver compile programs on as many threads as it likes
+	if (GLAD_GL_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
 	}
 
-	m_depthShader = std::make_shared<Shader>(RES_DIR "/shaders/depth_vert.glsl", RES_DIR "/shaders/empty_frag.glsl");
-	m_lightingShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/quad_frag.glsl");
-	m_ssaoShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/ssao_frag.glsl");
-	m_ssaoBlurShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/ssao_blur_frag.glsl");
-	m_brightShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/bright_frag.glsl");
-	m_finalCompoShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/final_composite.glsl");
+	m_pbrShader = ResourceCache::get().getShader(RES_DIR "/shaders/basic_vert.glsl", RES_DIR  "/shaders/pbr_frag.glsl", Material::featureDefines());
+
+	m_depthShader = ResourceCache::get().getShader(RES_DIR "/shaders/depth_vert.glsl", RES_DIR "/shaders/empty_frag.glsl");
+	m_lightingShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/quad_frag.glsl", std::vector<std::string>{ "USE_SSAO" });
+	m_ssaoShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/ssao_frag.glsl");
+	m_ssaoBlurShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/ssao_blur_frag.glsl");
+	m_brightShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/bright_frag.glsl");
+	m_finalCompoShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/final_composite.glsl", std::vector<std::string>{ "USE_BLOOM" });
+	m_lightingShader->prepare(USE_SSAO_FEATURE);
+	m_finalCompoShader->prepare(USE_BLOOM_FEATURE);
+
+	// Start the workers now, the GL thread owns the first job queue
+	JobSystem::get();
+
+	m_renderQueue = std::make_unique<RenderQueue>();
+	m_shadowQueue = std::make_unique<RenderQueue>();
+	m_frameUniforms = std::make_unique<UniformBuffer>(sizeof(FrameUniforms), FrameUniforms::BINDING);
 
 	// Initialize Background framebuffer
 	m_backgroundFB = std::make_unique<Framebuffer>(window_width, window_height);
@@ -228,17 +251,6 @@ void Renderer::clear()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-void Renderer::updateLighting()
-{
-	if (m_pbrShader)
-	{
-		m_pbrShader->bind();
-		m_pbrShader->setUniform3f("lightDir", lightDir.x, lightDir.y, lightDir.z);
-		m_pbrShader->unbind();
-	}
-}
-
-
 void Renderer::render()
 {
 	// Background pass
@@ -248,23 +260,63 @@ void Renderer::render()
 	m_currentScene->drawSkybox(m_camera->getViewMatrix(), m_camera->getProjectionMatrix());
 	m_backgroundFB->unbind();
 
+	// light space matrix
+	glm::mat4 lightSpaceMatrix = glm::ortho(-35.0f, 35.0f, -35.0f, 35.0f, 0.1f, 75.0f);
+	glm::vec3 lightPos = lightDir*20.0f;
+	lightSpaceMatrix *= glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// Scene preparation runs on the job system: the transforms first, then the camera and light culls
+	// side by side, each followed by the sort and instance build of its queue. This thread helps
+	// while it waits and only does the GL side once the results are in.
+	m_currentScene->updateTransforms();
+	const Scene& scene = *m_currentScene;
+	m_cullingStats.entityCount = scene.getEntityCount();
+
+	JobSystem& jobs = JobSystem::get();
+	JobCounter cameraCulled, lightCulled, queuesPrepared;
+	Frustum cameraFrustum(m_camera->getProjectionMatrix() * m_camera->getViewMatrix());
+	Frustum lightFrustum(lightSpaceMatrix);
+	if (useFrustumCulling) {
+		jobs.run([&]() { m_cullingStats.cameraVisible = scene.cullFrustum(cameraFrustum, m_cameraVisibility); }, &cameraCulled);
+		jobs.run([&]() { m_cullingStats.lightVisible = scene.cullFrustum(lightFrustum, m_lightVisibility); }, &lightCulled);
+	}
+	else {
+		m_cameraVisibility.assign(scene.getEntityCount(), 1);
+		m_lightVisibility.assign(scene.getEntityCount(), 1);
+		m_cullingStats.cameraVisible = scene.getEntityCount();
+		m_cullingStats.lightVisible = scene.getEntityCount();
+	}
+	jobs.runAfter(cameraCulled, [&]() { m_renderQueue->prepare(scene, &m_cameraVisibility); }, &queuesPrepared);
+	jobs.runAfter(lightCulled, [&]() { m_shadowQueue->prepare(scene, &m_lightVisibility); }, &queuesPrepared);
+	jobs.wait(queuesPrepared);
+
+	// Group entities sharing a mesh and material into instanced batches
+	SubmissionMode submissionMode = useMultiDrawIndirect ? SubmissionMode::MultiDrawIndirect : SubmissionMode::Instanced;
+	m_renderQueue->setSubmissionMode(submissionMode);
+	m_shadowQueue->setSubmissionMode(submissionMode);
+	m_renderQueue->submit();
+	m_shadowQueue->submit();
+
+	// Frame uniforms, shared by the depth and geometry passes
+	FrameUniforms frame;
+	frame.view = m_camera->getViewMatrix();
+	frame.projection = m_camera->getProjectionMatrix();
+	frame.lightSpaceMatrix = lightSpaceMatrix;
+	frame.camPos = m_camera->getPosition();
+	frame.lightDir = lightDir;
+	frame.lightColor = m_lightColor;
+	frame.irradianceSH = m_currentScene->getIrradianceSH();
+	m_frameUniforms->update(&frame, sizeof(FrameUniforms));
+	m_frameUniforms->bind();
+
 	// Depth pass
 	m_depthFB->bind();
 	glViewport(0, 0, 2048, 2048); // TODO use variables for width and height
 	glClear(GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_FRONT);
-	// light space matrix
-	glm::mat4 lightSpaceMatrix = glm::ortho(-35.0f, 35.0f, -35.0f, 35.0f, 0.1f, 75.0f);
-	glm::vec3 lightPos = lightDir*20.0f;
-	lightSpaceMatrix *= glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 	m_depthShader->bind();
-	m_depthShader->setUniformMat4f("lightSpaceMatrix", lightSpaceMatrix);
-	for (auto& entity : m_currentScene->getEntities())
-	{
-		m_depthShader->setUniformMat4f("model", entity->getModelMatrix());
-		entity->drawMesh();
-	}
+	m_shadowQueue->drawDepth();
 	m_depthFB->unbind();
 	glViewport(0, 0, window_width, window_height); // reset viewport
 	
@@ -273,14 +325,12 @@ void Renderer::render()
 	{
 		m_geometryFB->bind();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glm::vec3 camPos = m_camera->getPosition();
-		m_pbrShader->bind();
-		m_pbrShader->setUniform3f("camPos", camPos.x, camPos.y, camPos.z); 
-		m_pbrShader->setUniformMat4f("lightSpaceMatrix", lightSpaceMatrix);
 		glActiveTexture(GL_TEXTURE19);
 		glBindTexture(GL_TEXTURE_2D, m_depthFB->depthTexture);
-		m_pbrShader->setUniform1i("shadowMap", 19);
-		m_currentScene->draw(m_camera->getViewMatrix(), m_camera->getProjectionMatrix());
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		m_currentScene->bindEnvironment();
+		m_renderQueue->drawGeometry();
 	}
 
 	// SSAO
@@ -314,19 +364,15 @@ void Renderer::render()
 	// Lighting pass (SSAO, tone mapping)
 	m_hdrFB->bind();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	m_lightingShader->bind();
+	m_lightingShader->bind(useSSAO ? USE_SSAO_FEATURE : 0);
 	glActiveTexture(GL_TEXTURE13);
 	glBindTexture(GL_TEXTURE_2D, m_geometryFB->textures[0]);
 	m_lightingShader->setUniform1i("screenTexture", 13);
 	if (useSSAO) {
-		m_lightingShader->setUniform1i("useSSAO", 1);
-	}
-	else {
-		m_lightingShader->setUniform1i("useSSAO", 0);
+		glActiveTexture(GL_TEXTURE14);
+		glBindTexture(GL_TEXTURE_2D, m_ssaoBlurFB->textures[0]);
+		m_lightingShader->setUniform1i("ssaoTexture", 14);
 	}
-	glActiveTexture(GL_TEXTURE14);
-	glBindTexture(GL_TEXTURE_2D, m_ssaoBlurFB->textures[0]);
-	m_lightingShader->setUniform1i("ssaoTexture", 14);
 	renderQuad();
 	m_lightingShader->unbind();
 	m_hdrFB->unbind();
@@ -353,7 +399,7 @@ void Renderer::render()
 	// Final composite pass
 	m_finalCompositeFB->bind();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	m_finalCompoShader->bind();
+	m_finalCompoShader->bind(useBloom ? USE_BLOOM_FEATURE : 0);
 	glActiveTexture(GL_TEXTURE17);
 	glBindTexture(GL_TEXTURE_2D, m_hdrFB->textures[0]); // composite
 	m_finalCompoShader->setUniform1i("sceneTexture", 17);
@@ -364,14 +410,10 @@ void Renderer::render()
 
 	if (useBloom)
 	{
-		m_finalCompoShader->setUniform1i("useBloom", 1);
 		glActiveTexture(GL_TEXTURE16);
 		glBindTexture(GL_TEXTURE_2D, m_bloomRenderer->bloomTexture()); // bloom
 		m_finalCompoShader->setUniform1i("bloomTexture", 16);
 	}
-	else {
-		m_finalCompoShader->setUniform1i("useBloom", 0);
-	}
 
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -383,6 +425,12 @@ void Renderer::render()
 
 void Renderer::update()
 {
+	// Finish textures decoded since the last frame before anything binds them
+	TextureLoader::get().update();
+	if (m_currentScene) {
+		m_currentScene->updateEnvironment();
+	}
+
 	clear();
 	render();
 	renderUI();
@@ -512,11 +560,13 @@ bool BloomRenderer::init(unsigned int windowWidth, unsigned int windowHeight, un
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	m_downsampleShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/bloom_downsample.glsl");
+	m_downsampleShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/bloom_downsample.glsl");
+	m_downsampleShader->bind();
 	m_downsampleShader->setUniform1i("srcTexture", 0);
 	m_downsampleShader->unbind();
 
-	m_upsampleShader = std::make_unique<Shader>(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/bloom_upsample.glsl");
+	m_upsampleShader = ResourceCache::get().getShader(RES_DIR "/shaders/quad_vert.glsl", RES_DIR "/shaders/bloom_upsample.glsl");
+	m_upsampleShader->bind();
 	m_upsampleShader->setUniform1i("srcTexture", 0);
 	m_upsampleShader->unbind();
 
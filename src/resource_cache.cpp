@@ -0,0 +1,124 @@
+#include "resource_cache.h"
+#include "mesh_arena.h"
+#include <filesystem>
+
+ResourceCache& ResourceCache::get()
+{
+	static ResourceCache cache;
+	return cache;
+}
+
+std::string ResourceCache::canonicalPath(const std::string& path)
+{
+	if (path.empty()) {
+		return path;
+	}
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+	return error ? path : canonical.generic_string();
+}
+
+std::shared_ptr<Texture> ResourceCache::getTexture(const std::string& path)
+{
+	return findOrCreate(m_textures, "texture:" + canonicalPath(path), [&]() {
+		return std::make_shared<Texture>(path);
+	});
+}
+
+std::shared_ptr<Texture> ResourceCache::getOrmTexture(const std::string& occlusionPath, const std::string& roughnessPath, const std::string& metallicPath)
+{
+	std::string key = "orm:" + canonicalPath(occlusionPath) + "|" + canonicalPath(roughnessPath) + "|" + canonicalPath(metallicPath);
+	return findOrCreate(m_textures, key, [&]() {
+		return std::make_shared<Texture>(occlusionPath, roughnessPath, metallicPath);
+	});
+}
+
+std::shared_ptr<Mesh> ResourceCache::getModel(const std::string& path)
+{
+	return findOrCreate(m_meshes, "model:" + canonicalPath(path), [&]() {
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+		mesh->loadModel(path);
+		return mesh;
+	});
+}
+
+std::shared_ptr<Mesh> ResourceCache::getSphere(float radius, unsigned int segments)
+{
+	return findOrCreate(m_meshes, "sphere:" + std::to_string(radius) + "|" + std::to_string(segments), [&]() {
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+		mesh->loadSphere(radius, segments);
+		return mesh;
+	});
+}
+
+std::shared_ptr<Mesh> ResourceCache::getCube(float size)
+{
+	return findOrCreate(m_meshes, "cube:" + std::to_string(size), [&]() {
+		std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+		mesh->loadCube(size);
+		return mesh;
+	});
+}
+
+std::shared_ptr<Shader> ResourceCache::getShader(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& features)
+{
+	// Feature order matters, it decides the variant mask bits
+	std::string key = "shader:" + canonicalPath(vertexPath) + "|" + canonicalPath(fragmentPath);
+	for (const std::string& feature : features) {
+		key += "|" + feature;
+	}
+	return findOrCreate(m_shaders, key, [&]() {
+		return std::make_shared<Shader>(vertexPath, fragmentPath, features);
+	});
+}
+
+std::shared_ptr<ComputeShader> ResourceCache::getComputeShader(const std::string& path, const std::vector<std::string>& defines)
+{
+	std::string key = "compute:" + canonicalPath(path);
+	for (const std::string& define : defines) {
+		key += "|" + define;
+	}
+	return findOrCreate(m_computeShaders, key, [&]() {
+		return std::make_shared<ComputeShader>(path, defines);
+	});
+}
+
+void ResourceCache::evictExpired()
+{
+	std::erase_if(m_textures, [](const auto& entry) { return entry.second.expired(); });
+	std::erase_if(m_meshes, [](const auto& entry) { return entry.second.expired(); });
+	std::erase_if(m_shaders, [](const auto& entry) { return entry.second.expired(); });
+	std::erase_if(m_computeShaders, [](const auto& entry) { return entry.second.expired(); });
+}
+
+ResourceStats ResourceCache::getStats() const
+{
+	ResourceStats stats;
+	for (const auto& [key, entry] : m_textures) {
+		if (std::shared_ptr<Texture> texture = entry.lock()) {
+			stats.textureCount++;
+			stats.textureBytes += texture->getGpuBytes();
+		}
+	}
+	for (const auto& [key, entry] : m_meshes) {
+		if (std::shared_ptr<Mesh> mesh = entry.lock()) {
+			stats.meshCount++;
+			stats.meshBytes += mesh->getGpuBytes();
+		}
+	}
+	for (const auto& [key, entry] : m_shaders) {
+		if (!entry.expired()) {
+			stats.shaderCount++;
+		}
+	}
+	for (const auto& [key, entry] : m_computeShaders) {
+		if (!entry.expired()) {
+			stats.shaderCount++;
+		}
+	}
+	const MeshArena& arena = MeshArena::get();
+	stats.meshArenaBytes = arena.getVertexCount() * sizeof(Vertex) + arena.getIndexCount() * sizeof(unsigned int);
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+	return stats;
+}
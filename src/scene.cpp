@@ -1,6 +1,22 @@
 #include "scene.h"
+#include "frustum.h"
+#include "job_system.h"
 #include <iostream>
+#include <algorithm>
 #include <skybox.h>
+#include <glm/ext/matrix_transform.hpp>
+
+namespace {
+	// Below this many entities the SIMD scan beats walking the tree
+	const size_t LINEAR_CULL_LIMIT = 256;
+	// Updating a leaf walks its ancestors, a full refit visits every node once: past one dirty
+	// entity in this many the refit is cheaper
+	const size_t FULL_REFIT_RATIO = 16;
+	// Rebuild once refits have made the tree this much more expensive than a fresh SAH build
+	const float REBUILD_COST_RATIO = 1.5f;
+	// Entities per transform job, enough to hide the cost of scheduling it
+	const size_t TRANSFORM_JOB_SIZE = 256;
+}
 
 Scene::Scene()
 {
@@ -13,23 +29,32 @@ Scene::~Scene()
 {
 }
 
-void Scene::draw(const glm::mat4& view, const glm::mat4& projection)
+void Scene::bindEnvironment()
 {
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
-
-
 	if (m_skybox) {
 		m_skybox->bindTextures();
 	}
+}
 
-	// Draw entities
-	for (auto& entity : m_entities)
-	{
-		entity->draw(view, projection);
+void Scene::setEnvironment(const std::string& path)
+{
+	if (m_skybox) {
+		m_skybox->setEnvironment(path);
+	}
+}
+
+void Scene::updateEnvironment()
+{
+	if (m_skybox) {
+		m_skybox->update();
 	}
 }
 
+SHIrradiance Scene::getIrradianceSH() const
+{
+	return m_skybox ? m_skybox->getIrradianceSH() : SHIrradiance{};
+}
+
 void Scene::drawSkybox(const glm::mat4& view, const glm::mat4& projection)
 {
 	if (m_skybox) {
@@ -38,10 +63,258 @@ void Scene::drawSkybox(const glm::mat4& view, const glm::mat4& projection)
 }
 
 
-void Scene::addEntity(std::shared_ptr<Entity> entity) {
-	m_entities.push_back(entity);
+MaterialId Scene::addMaterial(const Material& material)
+{
+	m_materials.push_back(material);
+	return static_cast<MaterialId>(m_materials.size() - 1);
 }
 
-void Scene::deleteEntity(std::shared_ptr<Entity> entity) {
-	m_entities.erase(std::remove(m_entities.begin(), m_entities.end(), entity), m_entities.end());
-}
\ No newline at end of file
+MeshId Scene::registerMesh(std::shared_ptr<Mesh> mesh)
+{
+	// A handful of meshes per scene, a linear search is enough
+	for (size_t i = 0; i < m_meshes.size(); ++i) {
+		if (m_meshes[i] == mesh) {
+			return static_cast<MeshId>(i);
+		}
+	}
+	m_meshes.push_back(std::move(mesh));
+	return static_cast<MeshId>(m_meshes.size() - 1);
+}
+
+EntityHandle Scene::createEntity(std::shared_ptr<Mesh> mesh, MaterialId material, const glm::vec3& position, const std::string& name)
+{
+	uint32_t slot;
+	if (!m_freeSlots.empty()) {
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(m_generations.size());
+		m_generations.push_back(0);
+		m_slotToDense.push_back(0);
+	}
+	m_generations[slot]++;
+
+	uint32_t dense = static_cast<uint32_t>(m_positions.size());
+	m_slotToDense[slot] = dense;
+	m_denseToSlot.push_back(slot);
+
+	m_positions.push_back(position);
+	m_rotations.push_back(glm::vec3(0.0f));
+	m_scales.push_back(glm::vec3(1.0f));
+	m_worldMatrices.push_back(glm::mat4(1.0f));
+	m_normalMatrices.push_back(glm::mat4(1.0f));
+	m_worldBounds.push_back(AABB());
+	m_meshIds.push_back(registerMesh(std::move(mesh)));
+	m_materialIds.push_back(material);
+	m_transformDirty.push_back(1);
+	m_anyTransformDirty = true;
+	m_bvhProxies.push_back(Bvh::NULL_NODE);
+	m_names.push_back(name);
+
+	return { slot, m_generations[slot] };
+}
+
+void Scene::destroyEntity(EntityHandle handle)
+{
+	if (!isAlive(handle)) {
+		return;
+	}
+
+	// Move the last entity into the hole so the arrays stay packed
+	uint32_t dense = m_slotToDense[handle.index];
+	if (m_bvhProxies[dense] != Bvh::NULL_NODE) {
+		m_bvh.remove(m_bvhProxies[dense]);
+	}
+
+	uint32_t last = static_cast<uint32_t>(m_positions.size() - 1);
+	if (dense != last) {
+		m_positions[dense] = m_positions[last];
+		m_rotations[dense] = m_rotations[last];
+		m_scales[dense] = m_scales[last];
+		m_worldMatrices[dense] = m_worldMatrices[last];
+		m_normalMatrices[dense] = m_normalMatrices[last];
+		m_worldBounds[dense] = m_worldBounds[last];
+		m_meshIds[dense] = m_meshIds[last];
+		m_materialIds[dense] = m_materialIds[last];
+		m_transformDirty[dense] = m_transformDirty[last];
+		m_bvhProxies[dense] = m_bvhProxies[last];
+		m_names[dense] = std::move(m_names[last]);
+		m_denseToSlot[dense] = m_denseToSlot[last];
+		m_slotToDense[m_denseToSlot[dense]] = dense;
+	}
+	m_positions.pop_back();
+	m_rotations.pop_back();
+	m_scales.pop_back();
+	m_worldMatrices.pop_back();
+	m_normalMatrices.pop_back();
+	m_worldBounds.pop_back();
+	m_meshIds.pop_back();
+	m_materialIds.pop_back();
+	m_transformDirty.pop_back();
+	m_bvhProxies.pop_back();
+	m_names.pop_back();
+	m_denseToSlot.pop_back();
+
+	// Bumping the generation invalidates every copy of the handle
+	m_generations[handle.index]++;
+	m_freeSlots.push_back(handle.index);
+}
+
+bool Scene::isAlive(EntityHandle handle) const
+{
+	return handle.generation != 0 && handle.index < m_generations.size() && m_generations[handle.index] == handle.generation;
+}
+
+void Scene::setPosition(EntityHandle handle, const glm::vec3& position)
+{
+	uint32_t dense = denseIndex(handle);
+	if (position != m_positions[dense]) {
+		m_positions[dense] = position;
+		m_transformDirty[dense] = 1;
+		m_anyTransformDirty = true;
+	}
+}
+
+void Scene::setRotation(EntityHandle handle, const glm::vec3& rotation)
+{
+	uint32_t dense = denseIndex(handle);
+	if (rotation != m_rotations[dense]) {
+		m_rotations[dense] = rotation;
+		m_transformDirty[dense] = 1;
+		m_anyTransformDirty = true;
+	}
+}
+
+void Scene::setScale(EntityHandle handle, const glm::vec3& scale)
+{
+	uint32_t dense = denseIndex(handle);
+	if (scale != m_scales[dense]) {
+		m_scales[dense] = scale;
+		m_transformDirty[dense] = 1;
+		m_anyTransformDirty = true;
+	}
+}
+
+void Scene::updateTransforms()
+{
+	if (!m_anyTransformDirty) {
+		return;
+	}
+
+	// A few moved entities refit their own branch, many moved ones are refit in a single pass
+	size_t dirtyCount = std::count(m_transformDirty.begin(), m_transformDirty.end(), 1);
+	bool refitAll = dirtyCount * FULL_REFIT_RATIO >= m_positions.size();
+	bool needsRebuild = false;
+
+	JobSystem::get().parallelFor(m_positions.size(), TRANSFORM_JOB_SIZE, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			if (!m_transformDirty[i]) {
+				continue;
+			}
+
+			glm::mat4 world = glm::mat4(1.0f);
+			world = glm::translate(world, m_positions[i]);
+			world = glm::rotate(world, glm::radians(m_rotations[i].x), glm::vec3(1, 0, 0));
+			world = glm::rotate(world, glm::radians(m_rotations[i].y), glm::vec3(0, 1, 0));
+			world = glm::rotate(world, glm::radians(m_rotations[i].z), glm::vec3(0, 0, 1));
+			world = glm::scale(world, m_scales[i]);
+			m_worldMatrices[i] = world;
+
+			// Only the upper 3x3 is used, the translation does not affect normals
+			m_normalMatrices[i] = glm::mat4(glm::transpose(glm::inverse(glm::mat3(world))));
+
+			// Box around the transformed local box: the center moves with the matrix, the
+			// extents are summed over the absolute values of the matrix columns
+			const Mesh* mesh = m_meshes[m_meshIds[i]].get();
+			AABB local = mesh ? mesh->getBounds() : AABB();
+			glm::vec3 center = glm::vec3(world * glm::vec4((local.min + local.max) * 0.5f, 1.0f));
+			glm::vec3 halfSize = (local.max - local.min) * 0.5f;
+			glm::vec3 extent = glm::abs(glm::vec3(world[0])) * halfSize.x
+				+ glm::abs(glm::vec3(world[1])) * halfSize.y
+				+ glm::abs(glm::vec3(world[2])) * halfSize.z;
+			m_worldBounds[i] = { center - extent, center + extent };
+
+			// Leaves are distinct per entity, the refit below picks them up
+			if (refitAll && m_bvhProxies[i] != Bvh::NULL_NODE) {
+				m_bvh.setLeafBounds(m_bvhProxies[i], m_worldBounds[i]);
+				m_transformDirty[i] = 0;
+			}
+		}
+	});
+
+	// Inserts and ancestor updates change the shared part of the tree, one at a time
+	for (size_t i = 0; i < m_positions.size(); ++i) {
+		if (!m_transformDirty[i]) {
+			continue;
+		}
+
+		if (m_bvhProxies[i] == Bvh::NULL_NODE) {
+			// Batches of new entities, such as a scene load, get a full SAH build instead of one insert each
+			if (refitAll) {
+				needsRebuild = true;
+			}
+			else {
+				m_bvhProxies[i] = m_bvh.insert(m_worldBounds[i], m_denseToSlot[i]);
+			}
+		}
+		else {
+			m_bvh.update(m_bvhProxies[i], m_worldBounds[i]);
+		}
+		m_transformDirty[i] = 0;
+	}
+	m_anyTransformDirty = false;
+
+	if (needsRebuild) {
+		rebuildSpatialIndex();
+	}
+	else if (refitAll) {
+		m_bvh.refit();
+		if (m_bvh.getCost() > m_bvhBuildCost * REBUILD_COST_RATIO) {
+			rebuildSpatialIndex();
+		}
+	}
+}
+
+void Scene::rebuildSpatialIndex()
+{
+	m_bvh.build(m_worldBounds, m_denseToSlot, m_bvhProxies);
+	m_bvhBuildCost = m_bvh.getCost();
+}
+
+size_t Scene::cullFrustum(const Frustum& frustum, std::vector<uint8_t>& visible) const
+{
+	if (m_positions.size() < LINEAR_CULL_LIMIT) {
+		return frustum.cull(m_worldBounds, visible);
+	}
+
+	visible.assign(m_positions.size(), 0);
+	std::vector<uint32_t> slots;
+	m_bvh.queryFrustum(frustum, slots);
+	for (uint32_t slot : slots) {
+		visible[m_slotToDense[slot]] = 1;
+	}
+	return slots.size();
+}
+
+void Scene::queryBox(const AABB& box, std::vector<EntityHandle>& handles) const
+{
+	std::vector<uint32_t> slots;
+	m_bvh.queryBox(box, slots);
+	for (uint32_t slot : slots) {
+		handles.push_back({ slot, m_generations[slot] });
+	}
+}
+
+EntityHandle Scene::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance) const
+{
+	uint32_t slot;
+	float hitDistance;
+	if (!m_bvh.raycast(origin, direction, maxDistance, slot, hitDistance)) {
+		return EntityHandle();
+	}
+	if (distance) {
+		*distance = hitDistance;
+	}
+	return { slot, m_generations[slot] };
+}
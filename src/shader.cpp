@@ -1,134 +1,314 @@
 #include "shader.h"
 #include "glad/glad.h"
+#include "program_cache.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <chrono>
 #include <glm/gtc/type_ptr.hpp>
 
-Shader::Shader(const std::string& vertexFilePath, const std::string& fragmentFilePath)
-    : m_vertexFilePath(vertexFilePath), m_fragmentFilePath(fragmentFilePath), m_shaderID(0)
+Shader::Shader(const std::string& vertexFilePath, const std::string& fragmentFilePath, const std::vector<std::string>& features)
+    : m_vertexFilePath(vertexFilePath), m_fragmentFilePath(fragmentFilePath), m_features(features)
 {
-    m_shaderID = compile();
-    bind();
+    // Only submit the base variant, it is waited on at its first bind.
+    // Current until then so setters called before any bind find a variant.
+    loadSources();
+    m_current = &getVariant(0);
 }
 
 Shader::~Shader()
 {
-    glDeleteProgram(m_shaderID);
+    for (auto& [features, variant] : m_variants) {
+        if (variant.vertexShader) {
+            glDeleteShader(variant.vertexShader);
+            glDeleteShader(variant.fragmentShader);
+        }
+        glDeleteProgram(variant.program);
+    }
 }
 
-unsigned int Shader::compile() {
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
+bool Shader::loadSources()
+{
     // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
     std::ifstream VertexShaderStream(m_vertexFilePath, std::ios::in);
     if (VertexShaderStream.is_open()) {
         std::stringstream sstr;
         sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
+        m_vertexSource = sstr.str();
         VertexShaderStream.close();
     }
     else {
 		printf("Impossible to open %s.\n", m_vertexFilePath.c_str());
         getchar();
-        return 0;
+        return false;
     }
 
     // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
     std::ifstream FragmentShaderStream(m_fragmentFilePath, std::ios::in);
     if (FragmentShaderStream.is_open()) {
         std::stringstream sstr;
         sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
+        m_fragmentSource = sstr.str();
         FragmentShaderStream.close();
     }
     else {
 		printf("Impossible to open %s.\n", m_fragmentFilePath.c_str());
         getchar();
-        return 0;
+        return false;
     }
+    return true;
+}
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
+std::string Shader::injectDefines(const std::string& source, uint32_t features) const
+{
+    // Defines must come after #version, #line keeps the compiler messages on the file line numbers
+    size_t versionEnd = 0;
+    if (source.compare(0, 8, "#version") == 0) {
+        versionEnd = source.find('\n');
+        versionEnd = versionEnd == std::string::npos ? source.size() : versionEnd + 1;
+    }
 
-    // Compile Vertex Shader
-    printf("Compiling vertex shader\n");
+    std::string defines;
+    for (size_t i = 0; i < m_features.size(); ++i) {
+        if (features & (1u << i)) {
+            defines += "#define " + m_features[i] + " 1\n";
+        }
+    }
+    if (defines.empty()) {
+        return source;
+    }
+    defines += "#line 2\n";
+
+    return source.substr(0, versionEnd) + defines + source.substr(versionEnd);
+}
+
+Shader::Variant& Shader::getVariant(uint32_t features)
+{
+    auto it = m_variants.find(features);
+    if (it != m_variants.end()) {
+        return it->second;
+    }
+
+    Variant& variant = m_variants[features];
+    submit(variant, features);
+    return variant;
+}
+
+void Shader::submit(Variant& variant, uint32_t features) {
+    variant.submitTime = std::chrono::steady_clock::now();
+    if (m_vertexSource.empty() || m_fragmentSource.empty()) {
+        variant.ready = true;
+        reflectUniforms(variant);
+        return;
+    }
+
+    std::string VertexShaderCode = injectDefines(m_vertexSource, features);
+    std::string FragmentShaderCode = injectDefines(m_fragmentSource, features);
+
+    // Reuse the linked binary from a previous run when the driver accepts it
+    variant.cacheKey = ProgramCache::computeKey(VertexShaderCode, FragmentShaderCode);
+    GLuint CachedProgramID = ProgramCache::load(variant.cacheKey);
+    if (CachedProgramID) {
+        variant.program = CachedProgramID;
+        variant.ready = true;
+        reflectUniforms(variant);
+        ProgramCache::recordLoad(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - variant.submitTime).count());
+        return;
+    }
+
+    // Compile both stages and link, the driver works on them in the background when it can
+    variant.vertexShader = glCreateShader(GL_VERTEX_SHADER);
     char const* VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-    glCompileShader(VertexShaderID);
+    glShaderSource(variant.vertexShader, 1, &VertexSourcePointer, NULL);
+    glCompileShader(variant.vertexShader);
+
+    variant.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    char const* FragmentSourcePointer = FragmentShaderCode.c_str();
+    glShaderSource(variant.fragmentShader, 1, &FragmentSourcePointer, NULL);
+    glCompileShader(variant.fragmentShader);
+
+    variant.program = glCreateProgram();
+    glAttachShader(variant.program, variant.vertexShader);
+    glAttachShader(variant.program, variant.fragmentShader);
+    ProgramCache::prepare(variant.program);
+    glLinkProgram(variant.program);
+    ProgramCache::recordCompileSubmit();
+}
+
+bool Shader::isComplete(const Variant& variant) const
+{
+    if (variant.ready) {
+        return true;
+    }
+    // Without the extension any status query blocks, so the variant counts as complete
+    if (!GLAD_GL_KHR_parallel_shader_compile) {
+        return true;
+    }
+
+    GLint completed = GL_FALSE;
+    glGetProgramiv(variant.program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+void Shader::finish(Variant& variant)
+{
+    if (variant.ready) {
+        return;
+    }
+
+    GLint Result = GL_FALSE;
+    int InfoLogLength;
 
     // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+    printf("Compiling vertex shader\n");
+    glGetShaderiv(variant.vertexShader, GL_INFO_LOG_LENGTH, &InfoLogLength);
     if (InfoLogLength > 0) {
         std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
+        glGetShaderInfoLog(variant.vertexShader, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
         printf("%s\n", &VertexShaderErrorMessage[0]);
     }
 
-    // Compile Fragment Shader
-    printf("Compiling fragment shader\n");
-    char const* FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-    glCompileShader(FragmentShaderID);
-
     // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+    printf("Compiling fragment shader\n");
+    glGetShaderiv(variant.fragmentShader, GL_INFO_LOG_LENGTH, &InfoLogLength);
     if (InfoLogLength > 0) {
         std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
+        glGetShaderInfoLog(variant.fragmentShader, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
         printf("%s\n", &FragmentShaderErrorMessage[0]);
     }
 
-    // Link the program
-    printf("Linking program\n");
-    GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
-    glLinkProgram(ProgramID);
-
     // Check the program
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+    printf("Linking program\n");
+    glGetProgramiv(variant.program, GL_LINK_STATUS, &Result);
+    glGetProgramiv(variant.program, GL_INFO_LOG_LENGTH, &InfoLogLength);
     if (InfoLogLength > 0) {
         std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+        glGetProgramInfoLog(variant.program, InfoLogLength, NULL, &ProgramErrorMessage[0]);
         printf("%s\n", &ProgramErrorMessage[0]);
     }
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
+    glDetachShader(variant.program, variant.vertexShader);
+    glDetachShader(variant.program, variant.fragmentShader);
 
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+    glDeleteShader(variant.vertexShader);
+    glDeleteShader(variant.fragmentShader);
+    variant.vertexShader = 0;
+    variant.fragmentShader = 0;
 
-    return ProgramID;
+    if (Result == GL_TRUE) {
+        ProgramCache::store(variant.cacheKey, variant.program);
+    }
+    // Measured from submission, so with parallel compile this is wall time rather than main thread time
+    ProgramCache::recordCompile(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - variant.submitTime).count());
+
+    variant.ready = true;
+    reflectUniforms(variant);
 }
 
-int Shader::getUniformLocation(const std::string& name)
+void Shader::reflectUniforms(Variant& variant)
 {
-    if (m_UniformLocationCache.find(name) != m_UniformLocationCache.end())
-    {
-        return m_UniformLocationCache[name];
+    std::vector<UniformSlot>& uniforms = variant.uniforms;
+    const unsigned int program = variant.program;
+
+    uniforms.clear();
+    if (program == 0) {
+        uniforms.push_back({ UINT32_MAX, -1 });
+        return;
     }
-    else {
-        int location = glGetUniformLocation(m_shaderID, name.c_str());
-        m_UniformLocationCache[name] = location;
-        return location;
+
+    GLint uniformCount = 0;
+    glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+    GLint maxNameLength = 0;
+    glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+
+    std::vector<char> name(maxNameLength + 1);
+    const GLenum property = GL_LOCATION;
+    for (GLint i = 0; i < uniformCount; ++i) {
+        GLint location = -1;
+        glGetProgramResourceiv(program, GL_UNIFORM, i, 1, &property, 1, NULL, &location);
+        if (location == -1) {
+            continue; // member of a uniform block
+        }
+
+        GLsizei length = 0;
+        glGetProgramResourceName(program, GL_UNIFORM, i, static_cast<GLsizei>(name.size()), &length, name.data());
+        std::string_view uniformName(name.data(), length);
+
+        // Arrays are reported as "name[0]", they are set through their base name
+        if (uniformName.ends_with("[0]")) {
+            uniformName.remove_suffix(3);
+        }
+        uniforms.push_back({ UniformId::fromName(uniformName).hash, location });
+    }
+
+    std::sort(uniforms.begin(), uniforms.end(), [](const UniformSlot& a, const UniformSlot& b) {
+        return a.hash < b.hash;
+    });
+    for (size_t i = 1; i < uniforms.size(); ++i) {
+        if (uniforms[i].hash == uniforms[i - 1].hash) {
+            std::cerr << "Warning: uniform hash collision in " << m_fragmentFilePath << std::endl;
+        }
+    }
+
+    // Sentinel so the lookup always has an element to land on
+    uniforms.push_back({ UINT32_MAX, -1 });
+}
+
+int Shader::getUniformLocation(UniformId id) const
+{
+    // Not reflected until its first bind, there is nothing to set yet
+    if (!m_current || m_current->uniforms.empty()) {
+        return -1;
+    }
+
+    // Branch-free lower bound, the comparison compiles to a conditional move
+    const UniformSlot* base = m_current->uniforms.data();
+    size_t count = m_current->uniforms.size();
+    while (count > 1) {
+        size_t half = count / 2;
+        base = (base[half - 1].hash < id.hash) ? base + half : base;
+        count -= half;
     }
+    return base->hash == id.hash ? base->location : -1;
 }
 
-void Shader::bind() const
+void Shader::prepare(uint32_t features)
 {
-    glUseProgram(m_shaderID);
+    getVariant(features);
+}
+
+bool Shader::isReady(uint32_t features)
+{
+    Variant& variant = getVariant(features);
+    if (variant.ready) {
+        return true;
+    }
+    if (GLAD_GL_KHR_parallel_shader_compile && isComplete(variant)) {
+        finish(variant);
+        return true;
+    }
+    return false;
+}
+
+void Shader::bind(uint32_t features)
+{
+    Variant& variant = getVariant(features);
+    if (features != 0 && !isReady(features) && GLAD_GL_KHR_parallel_shader_compile) {
+        // Draw with the base variant until this one has finished compiling
+        Variant& placeholder = getVariant(0);
+        finish(placeholder);
+        m_current = &placeholder;
+    }
+    else {
+        finish(variant);
+        m_current = &variant;
+    }
+    glUseProgram(m_current->program);
 }
 
 void Shader::unbind() const
@@ -136,92 +316,52 @@ void Shader::unbind() const
     glUseProgram(0);
 }
 
-void Shader::setUniform1f(const std::string& name, float value)
+void Shader::setUniform1f(UniformId id, float value)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniform1f(location, value);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniform1f(getUniformLocation(id), value);
 }
 
-void Shader::setUniform2f(const std::string& name, float v0, float v1)
+void Shader::setUniform2f(UniformId id, float v0, float v1)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniform2f(location, v0, v1);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniform2f(getUniformLocation(id), v0, v1);
 }
 
-void Shader::setUniform3f(const std::string& name, float v0, float v1, float v2)
+void Shader::setUniform3f(UniformId id, float v0, float v1, float v2)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniform3f(location, v0, v1, v2);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniform3f(getUniformLocation(id), v0, v1, v2);
 }
 
-void Shader::setUniform4f(const std::string& name, float v0, float v1, float v2, float v3)
+void Shader::setUniform4f(UniformId id, float v0, float v1, float v2, float v3)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniform4f(location, v0, v1, v2, v3);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniform4f(getUniformLocation(id), v0, v1, v2, v3);
 }
 
-void Shader::setUniformMat3f(const std::string& name, const glm::mat3& matrix)
+void Shader::setUniformMat3f(UniformId id, const glm::mat3& matrix)
 {
-	int location = getUniformLocation(name);
-	if (location != -1)
-		glUniformMatrix3fv(location, 1, GL_FALSE, &matrix[0][0]);
-	else
-		std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+	glUniformMatrix3fv(getUniformLocation(id), 1, GL_FALSE, &matrix[0][0]);
 }
 
-void Shader::setUniform1i(const std::string& name, int value)
+void Shader::setUniform1i(UniformId id, int value)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniform1i(location, value);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniform1i(getUniformLocation(id), value);
 }
 
-void Shader::setUniformMat4f(const std::string& name, const glm::mat4& matrix)
+void Shader::setUniformMat4f(UniformId id, const glm::mat4& matrix)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniformMatrix4fv(location, 1, GL_FALSE, &matrix[0][0]);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniformMatrix4fv(getUniformLocation(id), 1, GL_FALSE, &matrix[0][0]);
 }
 
-void Shader::setUniformVec3f(const std::string& name, const glm::vec3& vector)
+void Shader::setUniformVec3f(UniformId id, const glm::vec3& vector)
 {
-	int location = getUniformLocation(name);
-	if (location != -1)
-		glUniform3fv(location, 1, &vector[0]);
-	else
-		std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+	glUniform3fv(getUniformLocation(id), 1, &vector[0]);
 }
 
-void Shader::setUniformBool(const std::string& name, bool value)
+void Shader::setUniformBool(UniformId id, bool value)
 {
-    int location = getUniformLocation(name);
-    if (location != -1)
-        glUniform1i(location, value);
-    else
-        std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+    glUniform1i(getUniformLocation(id), value);
 }
 
-void Shader::setUniform3fv(const std::string& name, const std::vector<glm::vec3> vector, int count)
+void Shader::setUniform3fv(UniformId id, const std::vector<glm::vec3> vector, int count)
 {
-	int location = getUniformLocation(name);
-	if (location != -1)
-		glUniform3fv(location, count, glm::value_ptr(vector[0]));
-	else
-		std::cerr << "Warning: Uniform '" << name << "' not found in shader." << std::endl;
+	glUniform3fv(getUniformLocation(id), count, glm::value_ptr(vector[0]));
 }
@@ -2,8 +2,91 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <algorithm>
 #include "renderer.h"
+#include "resource_cache.h"
+#include "brdf_lut.h"
+#include "hdr_image.h"
 #include <stb_image.h>
+#include <future>
+#include <chrono>
+#include <utility>
+
+namespace {
+	// Everything the worker thread produces for an environment switch
+	struct DecodedEnvironment {
+		uint64_t cacheKey = 0;
+		bool cached = false;
+		MappedFile cacheFile;
+		HdrImage hdr; // Radiance files, decoded later straight into a pixel buffer
+		float* pixels = nullptr; // Any other format stb_image reads
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		SHIrradiance irradiance;
+
+		~DecodedEnvironment()
+		{
+			if (pixels) {
+				stbi_image_free(pixels);
+			}
+		}
+	};
+
+	// Part of the cache key, editing one of them invalidates the baked maps
+	std::vector<std::string> bakeShaderPaths()
+	{
+		return { RES_DIR"/shaders/equirectangular_frag.glsl", RES_DIR"/shaders/prefilter_comp.glsl", RES_DIR"/shaders/pack_rgb9e5_comp.glsl" };
+	}
+
+	std::unique_ptr<DecodedEnvironment> decodeEnvironment(std::string path, IblBakeParams params)
+	{
+		std::unique_ptr<DecodedEnvironment> decoded = std::make_unique<DecodedEnvironment>();
+
+		// A previous run may already have baked this image with the same shaders and sizes
+		decoded->cacheKey = IblCache::computeKey(path, bakeShaderPaths(), params);
+		if (IblCache::open(decoded->cacheKey, params, decoded->cacheFile, decoded->irradiance)) {
+			decoded->cached = true;
+			return decoded;
+		}
+
+		// Radiance files only need their header here, the scanlines are decoded once there is a buffer to put them in
+		if (decoded->hdr.open(path)) {
+			decoded->width = decoded->hdr.getWidth();
+			decoded->height = decoded->hdr.getHeight();
+			decoded->channels = 3;
+			return decoded;
+		}
+
+		stbi_set_flip_vertically_on_load_thread(true);
+		decoded->pixels = stbi_loadf(path.c_str(), &decoded->width, &decoded->height, &decoded->channels, 0);
+		if (decoded->pixels && decoded->channels >= 3) {
+			// Diffuse IBL straight from the radiance data, no convolution pass
+			decoded->irradiance = SphericalHarmonics::projectEquirectangular(decoded->pixels, decoded->width, decoded->height, decoded->channels);
+		}
+		return decoded;
+	}
+}
+
+/*
+	Environment switch in flight: decoded on a worker, then baked into its own maps step by step
+*/
+struct Skybox::PendingEnvironment {
+	std::string path;
+	IblBakeParams params; // Captured when the switch starts, the quality may change meanwhile
+	std::future<std::unique_ptr<DecodedEnvironment>> decode;
+	std::unique_ptr<DecodedEnvironment> decoded;
+	IblMaps maps;
+	unsigned int hdrTexture = 0;
+	// Radiance files are decoded to half floats on a worker, into a mapped pixel unpack buffer
+	unsigned int pixelBuffer = 0;
+	std::future<bool> stream;
+	// Shared exponent environments only: the faces are rendered into the staging texture
+	// and packed into the cubemap through a GL_R32UI view
+	unsigned int stagingTexture = 0;
+	unsigned int environmentView = 0;
+	std::deque<BakeStep> steps;
+};
 
 
 Skybox::Skybox()
@@ -52,11 +135,8 @@ Skybox::Skybox()
 		 1.0f, -1.0f,  1.0f
 	};
 
-	m_skyboxShader = std::make_unique<Shader>(RES_DIR"/shaders/skybox_vert.glsl", RES_DIR"/shaders/skybox_frag.glsl");
-	m_equirectangularToCubemapShader = std::make_unique<Shader>(RES_DIR"/shaders/equirectangular_vert.glsl", RES_DIR"/shaders/equirectangular_frag.glsl");
-	m_irradianceShader = std::make_unique<Shader>(RES_DIR"/shaders/equirectangular_vert.glsl", RES_DIR"/shaders/irradiance_frag.glsl");
-	m_prefilterShader = std::make_unique<Shader>(RES_DIR"/shaders/prefilter_vert.glsl", RES_DIR"/shaders/prefilter_frag.glsl");
-	m_brdfShader = std::make_unique<Shader>(RES_DIR"/shaders/brdf_vert.glsl", RES_DIR"/shaders/brdf_frag.glsl");
+	m_skyboxShader = ResourceCache::get().getShader(RES_DIR"/shaders/skybox_vert.glsl", RES_DIR"/shaders/skybox_frag.glsl");
+	m_equirectangularToCubemapShader = ResourceCache::get().getShader(RES_DIR"/shaders/equirectangular_vert.glsl", RES_DIR"/shaders/equirectangular_frag.glsl");
 
 	// Setup skybox vao and vbo
 	glGenVertexArrays(1, &m_skyboxVAO);
@@ -68,21 +148,29 @@ Skybox::Skybox()
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glBindVertexArray(0);
 
-	// Setup fbo
+	m_bakeParams = IblBakeParams::forQuality(m_quality);
+	m_activeParams = m_bakeParams;
+
+	// Setup fbo, the depth storage follows the environment size of the bake
 	glGenFramebuffers(1, &captureFBO);
 	glGenRenderbuffers(1, &captureRBO);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 2048, 2048);
+	resizeCaptureDepth(m_bakeParams.environmentSize);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGenQueries(TIMER_QUERY_COUNT, m_timerQueries);
 }
 
 Skybox::~Skybox()
 {
+	if (m_pending) {
+		abortPending();
+	}
+	glDeleteQueries(TIMER_QUERY_COUNT, m_timerQueries);
+	glDeleteTextures(1, &m_envCubemap);
+	glDeleteTextures(1, &m_prefilterMap);
 }
 
 void Skybox::draw(const glm::mat4& view, const glm::mat4& projection)
@@ -104,208 +192,452 @@ void Skybox::draw(const glm::mat4& view, const glm::mat4& projection)
 
 void Skybox::bindTextures()
 {
-	// IBL textures
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_irradianceMap);
-
+	// IBL textures, the diffuse part is in FrameBlock as SH coefficients
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, m_prefilterMap);
 
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
+	glBindTexture(GL_TEXTURE_2D, BrdfLut::getTexture());
 }
 
 void Skybox::loadHDRImage(std::string path)
 {
-	// Load radiance hdr map
-	stbi_set_flip_vertically_on_load(true);
-	int width, height, nrChannels;
-	float* data = stbi_loadf(path.c_str(), &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glGenTextures(1, &m_hdrTexture);
-		glBindTexture(GL_TEXTURE_2D, m_hdrTexture);
-		if (nrChannels == 3) {
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+	setEnvironment(path);
+	while (m_pending) {
+		finishPending();
+	}
+}
+
+void Skybox::setEnvironment(const std::string& path)
+{
+	// One switch at a time, the latest request starts when the current one completes
+	if (m_pending) {
+		m_queuedPath = path;
+		return;
+	}
+
+	m_pending = std::make_unique<PendingEnvironment>();
+	m_pending->path = path;
+	m_pending->params = m_bakeParams;
+	m_pending->decode = std::async(std::launch::async, decodeEnvironment, path, m_bakeParams);
+}
+
+void Skybox::setQuality(IblQuality quality)
+{
+	if (quality == m_quality) {
+		return;
+	}
+	m_quality = quality;
+	m_bakeParams = IblBakeParams::forQuality(quality);
+
+	// Rebake the newest requested environment, not the one on screen, so a switch in flight is not undone
+	std::string path = m_environmentPath;
+	if (!m_queuedPath.empty()) {
+		path = m_queuedPath;
+	}
+	else if (m_pending) {
+		path = m_pending->path;
+	}
+	if (!path.empty()) {
+		setEnvironment(path);
+	}
+}
+
+size_t Skybox::getMemoryBytes() const
+{
+	// Irradiance lives in the frame uniforms, only the cubemaps count
+	return m_activeParams.getEnvironmentBytes() + m_activeParams.getPrefilterBytes();
+}
+
+size_t Skybox::getPendingSteps() const
+{
+	return m_pending ? m_pending->steps.size() : 0;
+}
+
+void Skybox::update()
+{
+	readTimerQueries();
+	if (!m_pending) {
+		return;
+	}
+
+	PendingEnvironment& pending = *m_pending;
+	if (!pending.decoded) {
+		if (pending.decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return;
 		}
-		else if (nrChannels == 4) {
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, data);
+		pending.decoded = pending.decode.get();
+		if (!buildBakeSteps(pending)) {
+			abortPending();
+			startQueuedEnvironment();
+			return;
 		}
-		else {
-			std::cout << "Error: Unknown number of channels in hdr image" << std::endl;
+	}
+	if (pending.stream.valid()) {
+		if (pending.stream.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return;
 		}
+		if (!pending.stream.get()) {
+			std::cout << "Failed to decode HDR image: " << pending.path << std::endl;
+			abortPending();
+			startQueuedEnvironment();
+			return;
+		}
+	}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
+	// Spend the budget, at least one step per frame so an expensive step cannot stall the switch
+	double budget = rebuildBudgetMs * 1.0e6 / m_nsPerCost;
+	bool timed = m_timerQueryCost[m_nextTimerQuery] == 0.0;
+	if (timed) {
+		glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[m_nextTimerQuery]);
 	}
-	else
-	{
-		std::cout << "Failed to load HDR image: " << path << std::endl;
-		stbi_image_free(data);
+	double spent = 0.0;
+	do {
+		BakeStep step = std::move(pending.steps.front());
+		pending.steps.pop_front();
+		step.run();
+		spent += step.cost;
+	} while (!pending.steps.empty() && spent + pending.steps.front().cost <= budget);
+	if (timed) {
+		glEndQuery(GL_TIME_ELAPSED);
+		m_timerQueryCost[m_nextTimerQuery] = spent;
+		m_nextTimerQuery = (m_nextTimerQuery + 1) % TIMER_QUERY_COUNT;
 	}
 
+	if (pending.steps.empty()) {
+		completeEnvironment(false);
+	}
+}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+void Skybox::readTimerQueries()
+{
+	for (int i = 0; i < TIMER_QUERY_COUNT; ++i) {
+		if (m_timerQueryCost[i] == 0.0) {
+			continue;
+		}
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(m_timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			continue;
+		}
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(m_timerQueries[i], GL_QUERY_RESULT, &elapsed);
+
+		// Smooth the measured cost, the first measurement replaces the guess
+		double nsPerCost = static_cast<double>(elapsed) / m_timerQueryCost[i];
+		m_nsPerCost = m_timerCalibrated ? m_nsPerCost * 0.75 + nsPerCost * 0.25 : nsPerCost;
+		m_nsPerCost = std::max(m_nsPerCost, 1.0e-6);
+		m_timerCalibrated = true;
+		m_timerQueryCost[i] = 0.0;
+	}
+}
 
-	// Load cubemap
-	loadCubemap();
+void Skybox::finishPending()
+{
+	PendingEnvironment& pending = *m_pending;
+	if (!pending.decoded) {
+		pending.decoded = pending.decode.get();
+		if (!buildBakeSteps(pending)) {
+			abortPending();
+			startQueuedEnvironment();
+			return;
+		}
+	}
+	if (pending.stream.valid() && !pending.stream.get()) {
+		std::cout << "Failed to decode HDR image: " << pending.path << std::endl;
+		abortPending();
+		startQueuedEnvironment();
+		return;
+	}
+	while (!pending.steps.empty()) {
+		pending.steps.front().run();
+		pending.steps.pop_front();
+	}
+	completeEnvironment(true);
 }
 
-void Skybox::loadCubemap()
+bool Skybox::buildBakeSteps(PendingEnvironment& pending)
 {
-	// Diffuse IBL
-	// Create cubemap texture with hdr texture data
-	glGenTextures(1, &m_envCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_envCubemap);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 2048, 2048, 0, GL_RGB, GL_FLOAT, nullptr);
+	DecodedEnvironment& decoded = *pending.decoded;
+	if (!decoded.cached && !decoded.hdr.isOpen() && (!decoded.pixels || decoded.channels < 3)) {
+		std::cout << "Failed to load HDR image: " << pending.path << std::endl;
+		return false;
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-	glm::mat4 captureViews[] = {
-		glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-		glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
-		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
-	};
+	if (decoded.hdr.isOpen()) {
+		// Half floats are written by the decoding threads into driver memory, the only copy on the host
+		size_t bytes = decoded.hdr.getHalfBytes();
+		glGenBuffers(1, &pending.pixelBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pending.pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (!mapped) {
+			std::cout << "Could not map a pixel buffer for HDR image: " << pending.path << std::endl;
+			return false;
+		}
+		uint16_t* halves = static_cast<uint16_t*>(mapped);
+		pending.stream = std::async(std::launch::async, [&decoded, halves]() {
+			bool decodedImage = decoded.hdr.decode(halves, decoded.irradiance);
+			decoded.hdr.close();
+			return decodedImage;
+		});
+	}
 
-	m_equirectangularToCubemapShader->bind();
-	m_equirectangularToCubemapShader->setUniform1i("equirectangularMap", 0);
-	m_equirectangularToCubemapShader->setUniformMat4f("projection", captureProjection);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_hdrTexture);
+	const IblBakeParams params = pending.params;
+	pending.maps = allocateMaps(params);
+	if (!pending.pixelBuffer) {
+		// A streamed image is still being projected by the decoding threads, its upload step sets it
+		pending.maps.irradiance = decoded.irradiance;
+	}
+	const IblMaps maps = pending.maps;
+	const double environmentTexels = static_cast<double>(params.environmentSize) * params.environmentSize;
+
+	if (decoded.cached) {
+		// Upload the cached faces and levels one at a time, every level is in the entry
+		size_t sectionCount = IblCache::getSectionCount(params);
+		for (size_t i = 0; i < sectionCount; ++i) {
+			pending.steps.push_back({ environmentTexels / 6.0, [&decoded, params, maps, i]() {
+				IblCache::uploadSection(decoded.cacheFile, params, maps, i);
+			} });
+		}
+		return true;
+	}
 
-	glViewport(0, 0, 2048, 2048);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		m_equirectangularToCubemapShader->setUniformMat4f("view", captureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, m_envCubemap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// Shared exponent textures can neither be rendered to nor written by image stores
+	const bool packEnvironment = params.environmentFormat == GL_RGB9_E5;
+	const int environmentLevels = params.getEnvironmentLevels();
+	if (packEnvironment) {
+		glGenTextures(1, &pending.stagingTexture);
+		glBindTexture(GL_TEXTURE_2D, pending.stagingTexture);
+		glTexStorage2D(GL_TEXTURE_2D, environmentLevels, GL_RGBA16F, params.environmentSize, params.environmentSize);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenTextures(1, &pending.environmentView);
+		glTextureView(pending.environmentView, GL_TEXTURE_CUBE_MAP, maps.environment, GL_R32UI, 0, environmentLevels, 0, 6);
+	}
 
-		Renderer::renderCube();
+	// Upload the hdr image, the pixels are freed as soon as the GPU has a copy
+	pending.steps.push_back({ static_cast<double>(decoded.width) * decoded.height, [&pending, &decoded]() {
+		glGenTextures(1, &pending.hdrTexture);
+		glBindTexture(GL_TEXTURE_2D, pending.hdrTexture);
+		if (pending.pixelBuffer) {
+			// update() only runs this step once the stream is done
+			pending.maps.irradiance = decoded.irradiance;
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pending.pixelBuffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, decoded.width, decoded.height, 0, GL_RGB, GL_HALF_FLOAT, nullptr);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &pending.pixelBuffer);
+			pending.pixelBuffer = 0;
+		}
+		else if (decoded.channels == 3) {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, decoded.width, decoded.height, 0, GL_RGB, GL_FLOAT, decoded.pixels);
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, decoded.width, decoded.height, 0, GL_RGBA, GL_FLOAT, decoded.pixels);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		if (decoded.pixels) {
+			stbi_image_free(decoded.pixels);
+			decoded.pixels = nullptr;
+		}
+	} });
+
+	// Render the hdr texture into the environment cubemap, one face per step.
+	// Packed faces go through the staging texture and get their mips there.
+	std::shared_ptr<ComputeShader> packShader = packEnvironment ?
+		ResourceCache::get().getComputeShader(RES_DIR"/shaders/pack_rgb9e5_comp.glsl") : nullptr;
+	for (unsigned int face = 0; face < 6; ++face) {
+		double cost = packEnvironment ? environmentTexels * 3.0 : environmentTexels;
+		pending.steps.push_back({ cost, [this, &pending, params, maps, face, packShader, environmentLevels]() {
+			glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+			glm::mat4 captureViews[] = {
+				glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+				glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+				glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+				glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
+				glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
+				glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
+			};
+
+			m_equirectangularToCubemapShader->bind();
+			m_equirectangularToCubemapShader->setUniform1i("equirectangularMap", 0);
+			m_equirectangularToCubemapShader->setUniformMat4f("projection", captureProjection);
+			m_equirectangularToCubemapShader->setUniformMat4f("view", captureViews[face]);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, pending.hdrTexture);
+
+			resizeCaptureDepth(params.environmentSize);
+			glViewport(0, 0, params.environmentSize, params.environmentSize);
+			glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+			if (packShader) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pending.stagingTexture, 0);
+			}
+			else {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, maps.environment, 0);
+			}
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			Renderer::renderCube();
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, window_width, window_height);
+
+			if (!packShader) {
+				return;
+			}
+			glBindTexture(GL_TEXTURE_2D, pending.stagingTexture);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			packShader->bind();
+			packShader->setUniform1i("face", face);
+			for (int level = 0; level < environmentLevels; ++level) {
+				int levelSize = params.environmentSize >> level > 0 ? params.environmentSize >> level : 1;
+				packShader->setUniform1i("level", level);
+				packShader->setUniform1i("levelSize", levelSize);
+				glBindImageTexture(0, pending.environmentView, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32UI);
+				packShader->dispatch(levelSize, levelSize);
+			}
+			glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			// The prefilter samples the packed faces
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		} });
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, window_width, window_height);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_envCubemap);
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	// Environment mips, sampled by the prefilter and by the skybox
+	if (!packEnvironment) {
+		pending.steps.push_back({ environmentTexels * 2.0, [maps]() {
+			glBindTexture(GL_TEXTURE_CUBE_MAP, maps.environment);
+			glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		} });
+	}
 
+	// Prefilter one face of one mip per step, the image format is a compile time choice
+	std::vector<std::string> prefilterDefines;
+	if (params.prefilterFormat == GL_R11F_G11F_B10F) {
+		prefilterDefines.push_back("PREFILTER_R11F_G11F_B10F");
+	}
+	std::shared_ptr<ComputeShader> prefilterShader =
+		ResourceCache::get().getComputeShader(RES_DIR"/shaders/prefilter_comp.glsl", prefilterDefines);
+	for (int mip = 0; mip < params.prefilterLevels; ++mip) {
+		int mipSize = params.prefilterSize >> mip > 0 ? params.prefilterSize >> mip : 1;
+		float roughness = params.prefilterLevels > 1 ? (float)mip / (float)(params.prefilterLevels - 1) : 0.0f;
+		// Filtered importance sampling keeps the count low, wider lobes get a few more samples
+		int sampleCount = mip == 0 ? 1 : std::min(16 << mip, 256);
+		for (int face = 0; face < 6; ++face) {
+			double cost = static_cast<double>(mipSize) * mipSize * sampleCount;
+			pending.steps.push_back({ cost, [prefilterShader, params, maps, mip, mipSize, roughness, sampleCount, face]() {
+				prefilterShader->bind();
+				prefilterShader->setUniform1i("environmentSize", params.environmentSize);
+				prefilterShader->setUniform1f("roughness", roughness);
+				prefilterShader->setUniform1i("mipSize", mipSize);
+				prefilterShader->setUniform1i("sampleCount", sampleCount);
+				prefilterShader->setUniform1i("face", face);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, maps.environment);
+				glBindImageTexture(0, maps.prefilter, mip, GL_TRUE, 0, GL_WRITE_ONLY, params.prefilterFormat);
+				prefilterShader->dispatch(mipSize, mipSize);
+				glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, params.prefilterFormat);
+			} });
+		}
+	}
+	return true;
+}
 
-	// Create texture for convoluted irradiance cubemap
-	glGenTextures(1, &m_irradianceMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_irradianceMap);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
+void Skybox::completeEnvironment(bool storeInCache)
+{
+	std::unique_ptr<PendingEnvironment> pending = std::move(m_pending);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	// Swap the whole set at once so a frame never mixes maps of two environments
+	glDeleteTextures(1, &m_envCubemap);
+	glDeleteTextures(1, &m_prefilterMap);
+	glDeleteTextures(1, &pending->hdrTexture);
+	glDeleteTextures(1, &pending->stagingTexture);
+	glDeleteTextures(1, &pending->environmentView);
+	m_envCubemap = pending->maps.environment;
+	m_prefilterMap = pending->maps.prefilter;
+	m_irradianceSH = pending->maps.irradiance;
+	m_activeParams = pending->params;
+	m_environmentPath = pending->path;
+
+	if (pending->decoded->cached) {
+		std::cout << "Loaded IBL cache for " << pending->path << std::endl;
+	}
+	else if (storeInCache) {
+		// Reading the maps back stalls, so runtime switches are not written to the cache
+		IblCache::store(pending->decoded->cacheKey, pending->params, pending->maps);
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
+	startQueuedEnvironment();
+}
 
-	// Create irradiance cubemap
-	m_irradianceShader->bind();
-	m_irradianceShader->setUniform1i("environmentMap", 0);
-	m_irradianceShader->setUniformMat4f("projection", captureProjection);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_envCubemap);
+void Skybox::abortPending()
+{
+	std::unique_ptr<PendingEnvironment> pending = std::move(m_pending);
+	if (pending->decode.valid()) {
+		pending->decode.wait();
+	}
+	// The decoding threads write into the mapped buffer until the stream is done
+	if (pending->stream.valid()) {
+		pending->stream.wait();
+	}
+	glDeleteBuffers(1, &pending->pixelBuffer);
+	glDeleteTextures(1, &pending->hdrTexture);
+	glDeleteTextures(1, &pending->stagingTexture);
+	glDeleteTextures(1, &pending->environmentView);
+	glDeleteTextures(1, &pending->maps.environment);
+	glDeleteTextures(1, &pending->maps.prefilter);
+}
 
-	glViewport(0, 0, 32, 32);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		m_irradianceShader->setUniformMat4f("view", captureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, m_irradianceMap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		Renderer::renderCube();
+void Skybox::startQueuedEnvironment()
+{
+	if (!m_queuedPath.empty()) {
+		setEnvironment(std::exchange(m_queuedPath, std::string()));
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, window_width, window_height);
+}
 
-	// Specular IBL
-	// Create texture for prefiltered environment map
-	int specularSize = 512;
-	glGenTextures(1, &m_prefilterMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_prefilterMap);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, specularSize, specularSize, 0, GL_RGB, GL_FLOAT, nullptr);
+void Skybox::resizeCaptureDepth(int size)
+{
+	if (size == m_captureSize) {
+		return;
 	}
+	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	m_captureSize = size;
+}
+
+IblMaps Skybox::allocateMaps(const IblBakeParams& params)
+{
+	IblMaps maps;
+
+	// Environment cubemap, immutable storage so shared exponent maps can be packed through a view
+	glGenTextures(1, &maps.environment);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, maps.environment);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, params.getEnvironmentLevels(), params.environmentFormat, params.environmentSize, params.environmentSize);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-	// Generate mipmaps for the prefiltered environment map
-	m_prefilterShader->bind();
-	m_prefilterShader->setUniformMat4f("projection", captureProjection);
-	m_prefilterShader->setUniform1i("environmentMap", 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, m_envCubemap);
+	// Prefiltered environment map, one mip per roughness level
+	glGenTextures(1, &maps.prefilter);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, maps.prefilter);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, params.prefilterLevels, params.prefilterFormat, params.prefilterSize, params.prefilterSize);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
-	{
-		unsigned int mipWidth = specularSize * std::pow(0.5, mip);
-		unsigned int mipHeight = specularSize * std::pow(0.5, mip);
-		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-		glViewport(0, 0, mipWidth, mipHeight);
-		float roughness = (float)mip / (float)(maxMipLevels - 1);
-		m_prefilterShader->setUniform1f("roughness", roughness);
-		for (unsigned int i = 0; i < 6; ++i)
-		{
-			m_prefilterShader->setUniformMat4f("view", captureViews[i]);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, m_prefilterMap, mip);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			Renderer::renderCube();
-		}
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, window_width, window_height);
-
-	// Generate BRDF LUT texture
-	glGenTextures(1, &brdfLUTTexture);
-	glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, nullptr);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUTTexture, 0);
-
-	glViewport(0, 0, 512, 512);
-	m_brdfShader->bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	Renderer::renderQuad();
-
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	// Reset viewport to window dimensions
-	glViewport(0, 0, window_width, window_height);
+	return maps;
 }
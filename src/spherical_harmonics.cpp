@@ -0,0 +1,181 @@
+#include "spherical_harmonics.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPHERICAL_HARMONICS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const float PI = 3.14159265358979f;
+
+	// Basis constants of the 9 polynomials, see SHIrradiance
+	const float BASIS_CONSTANTS[9] = {
+		0.282095f,
+		0.488603f, 0.488603f, 0.488603f,
+		1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f
+	};
+
+	// Cosine lobe convolution per band divided by PI: 1, 2/3, 1/4
+	const float BAND_WEIGHTS[9] = {
+		1.0f,
+		2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+		0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+	};
+
+	void evaluatePolynomials(float x, float y, float z, float out[9])
+	{
+		out[0] = 1.0f;
+		out[1] = y;
+		out[2] = z;
+		out[3] = x;
+		out[4] = x * y;
+		out[5] = y * z;
+		out[6] = 3.0f * z * z - 1.0f;
+		out[7] = x * z;
+		out[8] = x * x - y * y;
+	}
+}
+
+SHAccumulator::SHAccumulator(int width, int height)
+	: m_width(width), m_height(height),
+	m_cosPhi(width), m_sinPhi(width), m_red(width), m_green(width), m_blue(width)
+{
+	// Same mapping as equirectangular_frag.glsl: u = atan(z, x) / 2PI + 0.5
+	for (int x = 0; x < width; ++x) {
+		float phi = ((x + 0.5f) / width - 0.5f) * 2.0f * PI;
+		m_cosPhi[x] = std::cos(phi);
+		m_sinPhi[x] = std::sin(phi);
+	}
+}
+
+void SHAccumulator::addRow(int row, const float* pixels, int channels)
+{
+	for (int x = 0; x < m_width; ++x) {
+		m_red[x] = pixels[x * channels + 0];
+		m_green[x] = pixels[x * channels + 1];
+		m_blue[x] = pixels[x * channels + 2];
+	}
+
+	float latitude = ((row + 0.5f) / m_height - 0.5f) * PI;
+	float cosLat = std::cos(latitude);
+	float sinLat = std::sin(latitude);
+
+	float rowSums[27] = {};
+	int x = 0;
+#ifdef SPHERICAL_HARMONICS_SSE2
+	__m128 acc[27];
+	for (__m128& a : acc) {
+		a = _mm_setzero_ps();
+	}
+	const __m128 vCosLat = _mm_set1_ps(cosLat);
+	const __m128 vy = _mm_set1_ps(sinLat);
+	const __m128 three = _mm_set1_ps(3.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; x + 4 <= m_width; x += 4) {
+		__m128 vx = _mm_mul_ps(vCosLat, _mm_loadu_ps(&m_cosPhi[x]));
+		__m128 vz = _mm_mul_ps(vCosLat, _mm_loadu_ps(&m_sinPhi[x]));
+		__m128 basis[9] = {
+			one, vy, vz, vx,
+			_mm_mul_ps(vx, vy),
+			_mm_mul_ps(vy, vz),
+			_mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(vz, vz)), one),
+			_mm_mul_ps(vx, vz),
+			_mm_sub_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy))
+		};
+		__m128 r = _mm_loadu_ps(&m_red[x]);
+		__m128 g = _mm_loadu_ps(&m_green[x]);
+		__m128 b = _mm_loadu_ps(&m_blue[x]);
+		for (int i = 0; i < 9; ++i) {
+			acc[i * 3 + 0] = _mm_add_ps(acc[i * 3 + 0], _mm_mul_ps(basis[i], r));
+			acc[i * 3 + 1] = _mm_add_ps(acc[i * 3 + 1], _mm_mul_ps(basis[i], g));
+			acc[i * 3 + 2] = _mm_add_ps(acc[i * 3 + 2], _mm_mul_ps(basis[i], b));
+		}
+	}
+	for (int i = 0; i < 27; ++i) {
+		float lanes[4];
+		_mm_storeu_ps(lanes, acc[i]);
+		rowSums[i] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+#endif
+	for (; x < m_width; ++x) {
+		float basis[9];
+		evaluatePolynomials(cosLat * m_cosPhi[x], sinLat, cosLat * m_sinPhi[x], basis);
+		for (int i = 0; i < 9; ++i) {
+			rowSums[i * 3 + 0] += basis[i] * m_red[x];
+			rowSums[i * 3 + 1] += basis[i] * m_green[x];
+			rowSums[i * 3 + 2] += basis[i] * m_blue[x];
+		}
+	}
+
+	// Texels shrink towards the poles, the rest of the solid angle is applied once at the end
+	for (int i = 0; i < 27; ++i) {
+		m_sums[i] += static_cast<double>(rowSums[i]) * cosLat;
+	}
+}
+
+void SHAccumulator::merge(const SHAccumulator& other)
+{
+	for (int i = 0; i < 27; ++i) {
+		m_sums[i] += other.m_sums[i];
+	}
+}
+
+SHIrradiance SHAccumulator::getIrradiance() const
+{
+	SHIrradiance sh;
+	double texelSolidAngle = (2.0 * PI / m_width) * (PI / m_height);
+	for (int i = 0; i < 9; ++i) {
+		double scale = texelSolidAngle * BASIS_CONSTANTS[i] * BASIS_CONSTANTS[i] * BAND_WEIGHTS[i];
+		sh.coefficients[i] = glm::vec4(
+			static_cast<float>(m_sums[i * 3 + 0] * scale),
+			static_cast<float>(m_sums[i * 3 + 1] * scale),
+			static_cast<float>(m_sums[i * 3 + 2] * scale),
+			0.0f);
+	}
+	return sh;
+}
+
+SHIrradiance SphericalHarmonics::projectEquirectangular(const float* pixels, int width, int height, int channels)
+{
+	if (!pixels || width <= 0 || height <= 0 || channels < 3) {
+		return SHIrradiance();
+	}
+
+	unsigned int coreCount = std::thread::hardware_concurrency();
+	int threadCount = std::clamp(static_cast<int>(coreCount), 1, height);
+	std::vector<SHAccumulator> partials(threadCount, SHAccumulator(width, height));
+	std::vector<std::thread> threads;
+	int rowsPerThread = (height + threadCount - 1) / threadCount;
+	for (int i = 0; i < threadCount; ++i) {
+		int rowBegin = i * rowsPerThread;
+		int rowEnd = std::min(height, rowBegin + rowsPerThread);
+		threads.emplace_back([&partials, i, pixels, width, channels, rowBegin, rowEnd]() {
+			for (int row = rowBegin; row < rowEnd; ++row) {
+				partials[i].addRow(row, pixels + static_cast<size_t>(row) * width * channels, channels);
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	// Summed in thread order so the result does not depend on scheduling
+	for (int i = 1; i < threadCount; ++i) {
+		partials[0].merge(partials[i]);
+	}
+	return partials[0].getIrradiance();
+}
+
+glm::vec3 SphericalHarmonics::evaluate(const SHIrradiance& sh, const glm::vec3& normal)
+{
+	float basis[9];
+	evaluatePolynomials(normal.x, normal.y, normal.z, basis);
+	glm::vec3 irradiance(0.0f);
+	for (int i = 0; i < 9; ++i) {
+		irradiance += glm::vec3(sh.coefficients[i]) * basis[i];
+	}
+	return glm::max(irradiance, glm::vec3(0.0f));
+}
@@ -1,4 +1,5 @@
 #include "texture.h"
+#include "texture_loader.h"
 #include <iostream>
 #include <algorithm>
 
@@ -13,38 +14,101 @@ Texture::Texture()
 
 Texture::Texture(std::string path)
 {
-	load(path.c_str());
+	m_type = typeFromPath(path);
+	create();
+
+	m_request = std::make_shared<TextureRequest>();
+	m_request->path = path;
+	m_request->texture = m_id;
+	m_request->type = m_type;
+	TextureLoader::get().request(m_request);
+}
+
+Texture::Texture(const std::string& occlusionPath, const std::string& roughnessPath, const std::string& metallicPath)
+{
+	m_type = TextureType::ORM;
+	create();
+
+	m_request = std::make_shared<TextureRequest>();
+	m_request->path = "ORM <" + occlusionPath + ", " + roughnessPath + ", " + metallicPath + ">";
+	m_request->channelPaths = { occlusionPath, roughnessPath, metallicPath };
+	m_request->texture = m_id;
+	m_request->type = m_type;
+	TextureLoader::get().request(m_request);
 }
 
 Texture::~Texture()
 {
+	if (m_request) {
+		m_request->cancelled = true;
+	}
 	glDeleteTextures(1, &m_id);
 }
 
-void Texture::load(const char* path)
+TextureType Texture::typeFromPath(const std::string& path)
 {
     std::string filename = path;
     std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
-    
+
     if (filename.find("albedo") != std::string::npos || filename.find("alb") != std::string::npos ||
         filename.find("diffuse") != std::string::npos || filename.find("color") != std::string::npos) {
-        m_type = TextureType::ALBEDO;
+        return TextureType::ALBEDO;
     }
     else if (filename.find("normal") != std::string::npos || filename.find("norm") != std::string::npos ||
         filename.find("nrm") != std::string::npos) {
-        m_type = TextureType::NORMAL;
+        return TextureType::NORMAL;
     }
     else if (filename.find("metallic") != std::string::npos || filename.find("metal") != std::string::npos) {
-        m_type = TextureType::METALLIC;
+        return TextureType::METALLIC;
     }
     else if (filename.find("roughness") != std::string::npos || filename.find("rough") != std::string::npos) {
-        m_type = TextureType::ROUGHNESS;
+        return TextureType::ROUGHNESS;
     }
     else if (filename.find("ao") != std::string::npos || filename.find("ambient") != std::string::npos ||
         filename.find("occlusion") != std::string::npos) {
-        m_type = TextureType::AO;
+        return TextureType::AO;
+    }
+    return TextureType::ALBEDO;
+}
+
+bool Texture::getUploadFormat(TextureType type, int channels, GLenum& internalFormat, GLenum& format)
+{
+    if (type == TextureType::ALBEDO) {
+        // Color textures should use sRGB
+        if (channels == 3) {
+            internalFormat = GL_SRGB;
+            format = GL_RGB;
+            return true;
+        }
+        if (channels == 4) {
+            internalFormat = GL_SRGB_ALPHA;
+            format = GL_RGBA;
+            return true;
+        }
+        return false;
+    }
+
+    // Non-color textures should use linear space
+    if (channels == 1) {
+        internalFormat = GL_R8;
+        format = GL_RED;
+        return true;
+    }
+    if (channels == 3) {
+        internalFormat = GL_RGB8;
+        format = GL_RGB;
+        return true;
     }
+    if (channels == 4) {
+        internalFormat = GL_RGBA8;
+        format = GL_RGBA;
+        return true;
+    }
+    return false;
+}
 
+void Texture::create()
+{
     glGenTextures(1, &m_id);
     glBindTexture(GL_TEXTURE_2D, m_id);
 
@@ -53,32 +117,26 @@ void Texture::load(const char* path)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::load(const char* path)
+{
+    m_type = typeFromPath(path);
+    create();
+    glBindTexture(GL_TEXTURE_2D, m_id);
 
     // Load image data
     int width, height, nrChannels;
     stbi_set_flip_vertically_on_load(true);  // Flip Y-axis during loading
     unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
 
-    if (data) {
-        // Different handling based on texture type and channel count
-        if (m_type == TextureType::ALBEDO) {
-            // Color textures should use sRGB
-            if (nrChannels == 3)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            else if (nrChannels == 4)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-        else {
-            // Non-color textures should use linear space
-            if (nrChannels == 1)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-            else if (nrChannels == 3)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            else if (nrChannels == 4)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-
+    GLenum internalFormat, format;
+    if (data && getUploadFormat(m_type, nrChannels, internalFormat, format)) {
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        // Uncompressed texels plus a third for the mip chain
+        m_gpuBytes = static_cast<size_t>(width) * height * (nrChannels == 3 ? 4 : nrChannels) * 4 / 3;
         std::cout << "Loaded texture: " << path << " (" << width << "x" << height << ", " << nrChannels << " channels)" << std::endl;
     }
     else {
@@ -91,10 +149,26 @@ void Texture::load(const char* path)
     unbind();
 }
 
+size_t Texture::getGpuBytes() const
+{
+	if (m_request) {
+		return m_request->gpuBytes;
+	}
+	return m_gpuBytes;
+}
+
+TextureState Texture::getState() const
+{
+	if (m_request) {
+		return m_request->state;
+	}
+	return m_id ? TextureState::Ready : TextureState::Failed;
+}
+
 void Texture::bind(unsigned int slot) const
 {
 	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, m_id);
+	glBindTexture(GL_TEXTURE_2D, isReady() ? m_id : TextureLoader::get().getPlaceholder(m_type));
 }
 
 void Texture::unbind() const
@@ -0,0 +1,752 @@
+#include "texture_compressor.h"
+#include "mapped_file.h"
+#include "hash.h"
+#include "glad/glad.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COMPRESSOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Bump the version whenever the encoders or the mip filter change
+	const uint32_t COMPRESSED_TEXTURE_VERSION = 1;
+
+	// BC7 4-bit interpolation weights, out of 64
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+	const uint32_t DDS_FOURCC_DX10 = 0x30315844; // "DX10"
+	// Largest side accepted when reading, well past any texture GL can allocate
+	const uint32_t MAX_DDS_SIZE = 1u << 16;
+	const uint32_t DXGI_FORMAT_BC4_UNORM = 80;
+	const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+	const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+	const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+	/*
+		DDS file layout:
+		magic | DDSHeader | DDSHeaderDX10 | levels
+	*/
+	struct DDSPixelFormat {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t bitMasks[4];
+	};
+
+	struct DDSHeader {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps[4];
+		uint32_t reserved2;
+	};
+
+	struct DDSHeaderDX10 {
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	static_assert(sizeof(DDSHeader) == 124, "DDSHeader must match the DDS file layout");
+
+	uint32_t toDXGIFormat(BlockFormat format)
+	{
+		switch (format) {
+		case BlockFormat::BC4: return DXGI_FORMAT_BC4_UNORM;
+		case BlockFormat::BC5: return DXGI_FORMAT_BC5_UNORM;
+		case BlockFormat::BC7: return DXGI_FORMAT_BC7_UNORM;
+		default: return DXGI_FORMAT_BC7_UNORM_SRGB;
+		}
+	}
+
+	size_t getLevelSize(BlockFormat format, int width, int height)
+	{
+		return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * TextureCompressor::getBlockSize(format);
+	}
+
+	void computeLevelOffsets(CompressedImage& image, int levelCount)
+	{
+		image.levelOffsets.assign(1, 0);
+		for (int level = 0; level < levelCount; ++level) {
+			size_t size = getLevelSize(image.format, image.getLevelWidth(level), image.getLevelHeight(level));
+			image.levelOffsets.push_back(image.levelOffsets.back() + size);
+		}
+	}
+
+	float srgbToLinear(unsigned char value)
+	{
+		static const std::vector<float> table = []() {
+			std::vector<float> values(256);
+			for (int i = 0; i < 256; ++i) {
+				float c = i / 255.0f;
+				values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return values;
+		}();
+		return table[value];
+	}
+
+	unsigned char linearToSrgb(float value)
+	{
+		static const std::vector<unsigned char> table = []() {
+			std::vector<unsigned char> values(4096);
+			for (int i = 0; i < 4096; ++i) {
+				float c = i / 4095.0f;
+				c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				values[i] = static_cast<unsigned char>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+			}
+			return values;
+		}();
+		return table[static_cast<int>(std::clamp(value, 0.0f, 1.0f) * 4095.0f + 0.5f)];
+	}
+
+	// 2x2 box filter. Color is averaged in linear space and normals are renormalized.
+	void downsample(const std::vector<unsigned char>& src, int width, int height, BlockFormat format, std::vector<unsigned char>& dst)
+	{
+		int dstWidth = std::max(1, width / 2);
+		int dstHeight = std::max(1, height / 2);
+		dst.resize(static_cast<size_t>(dstWidth) * dstHeight * 4);
+
+		for (int y = 0; y < dstHeight; ++y) {
+			for (int x = 0; x < dstWidth; ++x) {
+				const unsigned char* taps[4];
+				int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+				taps[0] = &src[(static_cast<size_t>(y0) * width + x0) * 4];
+				taps[1] = &src[(static_cast<size_t>(y0) * width + x1) * 4];
+				taps[2] = &src[(static_cast<size_t>(y1) * width + x0) * 4];
+				taps[3] = &src[(static_cast<size_t>(y1) * width + x1) * 4];
+				unsigned char* out = &dst[(static_cast<size_t>(y) * dstWidth + x) * 4];
+
+				if (format == BlockFormat::BC7_SRGB) {
+					for (int c = 0; c < 3; ++c) {
+						float sum = 0.0f;
+						for (const unsigned char* tap : taps) {
+							sum += srgbToLinear(tap[c]);
+						}
+						out[c] = linearToSrgb(sum * 0.25f);
+					}
+					out[3] = static_cast<unsigned char>((taps[0][3] + taps[1][3] + taps[2][3] + taps[3][3] + 2) / 4);
+				}
+				else if (format == BlockFormat::BC5) {
+					float n[3] = { 0.0f, 0.0f, 0.0f };
+					for (const unsigned char* tap : taps) {
+						for (int c = 0; c < 3; ++c) {
+							n[c] += tap[c] / 127.5f - 1.0f;
+						}
+					}
+					float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					for (int c = 0; c < 3; ++c) {
+						float value = length > 0.0f ? n[c] / length : (c == 2 ? 1.0f : 0.0f);
+						out[c] = static_cast<unsigned char>(std::clamp((value + 1.0f) * 127.5f + 0.5f, 0.0f, 255.0f));
+					}
+					out[3] = 255;
+				}
+				else {
+					for (int c = 0; c < 4; ++c) {
+						out[c] = static_cast<unsigned char>((taps[0][c] + taps[1][c] + taps[2][c] + taps[3][c] + 2) / 4);
+					}
+				}
+			}
+		}
+	}
+
+	void encodeLevel(const unsigned char* rgba, int width, int height, BlockFormat format, unsigned char* out)
+	{
+		const size_t blockSize = TextureCompressor::getBlockSize(format);
+		unsigned char block[64];
+
+		for (int by = 0; by < height; by += 4) {
+			for (int bx = 0; bx < width; bx += 4) {
+				// Blocks hanging over the edge repeat the last row and column
+				for (int y = 0; y < 4; ++y) {
+					int sy = std::min(by + y, height - 1);
+					for (int x = 0; x < 4; ++x) {
+						int sx = std::min(bx + x, width - 1);
+						std::memcpy(&block[(y * 4 + x) * 4], &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+					}
+				}
+
+				switch (format) {
+				case BlockFormat::BC4: TextureCompressor::encodeBC4Block(block, out); break;
+				case BlockFormat::BC5: TextureCompressor::encodeBC5Block(block, out); break;
+				default: TextureCompressor::encodeBC7Block(block, out); break;
+				}
+				out += blockSize;
+			}
+		}
+	}
+
+	// BC4 with the 8 value palette: endpoints are the block max and min, indices are 3 bits each
+	void encodeBC4Channel(const unsigned char* block, int channel, unsigned char* out)
+	{
+		unsigned char values[16];
+		for (int i = 0; i < 16; ++i) {
+			values[i] = block[i * 4 + channel];
+		}
+
+		int minValue = 255, maxValue = 0;
+		for (int i = 0; i < 16; ++i) {
+			minValue = std::min(minValue, static_cast<int>(values[i]));
+			maxValue = std::max(maxValue, static_cast<int>(values[i]));
+		}
+
+		out[0] = static_cast<unsigned char>(maxValue);
+		out[1] = static_cast<unsigned char>(minValue);
+		std::memset(out + 2, 0, 6);
+		if (maxValue == minValue) {
+			return;
+		}
+
+		// Step from max to min, 0 is max and 7 is min
+		int steps[16];
+		const float scale = 7.0f / (maxValue - minValue);
+#ifdef TEXTURE_COMPRESSOR_SSE2
+		const __m128 maxVector = _mm_set1_ps(static_cast<float>(maxValue));
+		const __m128 scaleVector = _mm_set1_ps(scale);
+		const __m128 half = _mm_set1_ps(0.5f);
+		for (int i = 0; i < 16; i += 4) {
+			__m128 v = _mm_set_ps(values[i + 3], values[i + 2], values[i + 1], values[i]);
+			__m128 t = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(maxVector, v), scaleVector), half);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&steps[i]), _mm_cvttps_epi32(t));
+		}
+#else
+		for (int i = 0; i < 16; ++i) {
+			steps[i] = static_cast<int>((maxValue - values[i]) * scale + 0.5f);
+		}
+#endif
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; ++i) {
+			// Palette order is max, min, then the six interpolated values from max to min
+			int index = steps[i] == 0 ? 0 : (steps[i] == 7 ? 1 : steps[i] + 1);
+			bits |= static_cast<uint64_t>(index) << (3 * i);
+		}
+		for (int i = 0; i < 6; ++i) {
+			out[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+		}
+	}
+
+	// Endpoint of BC7 mode 6: 7 bits per channel plus a p-bit shared by the four channels
+	void quantizeEndpoint(const float* color, int* quantized)
+	{
+		int bestError = INT32_MAX;
+		for (int pbit = 0; pbit < 2; ++pbit) {
+			int candidate[4];
+			int error = 0;
+			for (int c = 0; c < 4; ++c) {
+				int value = static_cast<int>(std::lround((color[c] - pbit) * 0.5f));
+				candidate[c] = std::clamp(value, 0, 127) * 2 + pbit;
+				int diff = candidate[c] - static_cast<int>(std::lround(color[c]));
+				error += diff * diff;
+			}
+			if (error < bestError) {
+				bestError = error;
+				std::memcpy(quantized, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	// Pick the closest palette entry for every pixel, returns the total squared error
+	int selectIndices(const unsigned char* block, const int* endpoint0, const int* endpoint1, int* indices)
+	{
+		int palette[16][4];
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < 4; ++c) {
+				palette[i][c] = ((64 - BC7_WEIGHTS[i]) * endpoint0[c] + BC7_WEIGHTS[i] * endpoint1[c] + 32) >> 6;
+			}
+		}
+
+		int totalError = 0;
+#ifdef TEXTURE_COMPRESSOR_SSE2
+		// Two palette entries per register, the squared distance of both comes out of one madd
+		__m128i paletteVectors[8];
+		for (int i = 0; i < 8; ++i) {
+			const int* a = palette[i * 2];
+			const int* b = palette[i * 2 + 1];
+			paletteVectors[i] = _mm_setr_epi16(a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3]);
+		}
+
+		for (int p = 0; p < 16; ++p) {
+			const unsigned char* pixel = &block[p * 4];
+			__m128i pixelVector = _mm_setr_epi16(pixel[0], pixel[1], pixel[2], pixel[3], pixel[0], pixel[1], pixel[2], pixel[3]);
+
+			alignas(16) int errors[4];
+			int bestError = INT32_MAX, bestIndex = 0;
+			for (int i = 0; i < 8; ++i) {
+				__m128i diff = _mm_sub_epi16(pixelVector, paletteVectors[i]);
+				__m128i squared = _mm_madd_epi16(diff, diff);
+				__m128i sum = _mm_add_epi32(squared, _mm_shuffle_epi32(squared, _MM_SHUFFLE(2, 3, 0, 1)));
+				_mm_store_si128(reinterpret_cast<__m128i*>(errors), sum);
+				if (errors[0] < bestError) {
+					bestError = errors[0];
+					bestIndex = i * 2;
+				}
+				if (errors[2] < bestError) {
+					bestError = errors[2];
+					bestIndex = i * 2 + 1;
+				}
+			}
+			indices[p] = bestIndex;
+			totalError += bestError;
+		}
+#else
+		for (int p = 0; p < 16; ++p) {
+			const unsigned char* pixel = &block[p * 4];
+			int bestError = INT32_MAX, bestIndex = 0;
+			for (int i = 0; i < 16; ++i) {
+				int error = 0;
+				for (int c = 0; c < 4; ++c) {
+					int diff = pixel[c] - palette[i][c];
+					error += diff * diff;
+				}
+				if (error < bestError) {
+					bestError = error;
+					bestIndex = i;
+				}
+			}
+			indices[p] = bestIndex;
+			totalError += bestError;
+		}
+#endif
+		return totalError;
+	}
+
+	// Least squares endpoints for a fixed set of indices, returns false when the system is singular
+	bool fitEndpoints(const unsigned char* block, const int* indices, float* endpoint0, float* endpoint1)
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int p = 0; p < 16; ++p) {
+			float b = BC7_WEIGHTS[indices[p]] / 64.0f;
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 4; ++c) {
+				ax[c] += a * block[p * 4 + c];
+				bx[c] += b * block[p * 4 + c];
+			}
+		}
+
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f) {
+			return false;
+		}
+		for (int c = 0; c < 4; ++c) {
+			endpoint0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+			endpoint1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	class BitWriter {
+	public:
+		explicit BitWriter(unsigned char* out) : m_out(out) { std::memset(out, 0, 16); }
+
+		void write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; ++i, ++m_position) {
+				m_out[m_position >> 3] |= ((value >> i) & 1) << (m_position & 7);
+			}
+		}
+
+	private:
+		unsigned char* m_out;
+		int m_position = 0;
+	};
+}
+
+BlockFormat TextureCompressor::formatFor(TextureType type)
+{
+	switch (type) {
+	case TextureType::ALBEDO: return BlockFormat::BC7_SRGB;
+	case TextureType::NORMAL: return BlockFormat::BC5;
+	case TextureType::ORM: return BlockFormat::BC7;
+	default: return BlockFormat::BC4;
+	}
+}
+
+unsigned int TextureCompressor::getGLFormat(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+	case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+	case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+	}
+}
+
+const char* TextureCompressor::getFormatName(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC4: return "BC4";
+	case BlockFormat::BC5: return "BC5";
+	case BlockFormat::BC7: return "BC7";
+	default: return "BC7 sRGB";
+	}
+}
+
+std::string TextureCompressor::cachePath(const std::vector<std::string>& sourcePaths, BlockFormat format)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	for (const std::string& sourcePath : sourcePaths) {
+		hashString(hash, sourcePath.c_str());
+		if (sourcePath.empty()) {
+			continue;
+		}
+
+		// The source size and modification time stand in for its contents
+		std::error_code error;
+		uintmax_t fileSize = std::filesystem::file_size(sourcePath, error);
+		if (error) {
+			return std::string();
+		}
+		auto writeTime = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+		if (error) {
+			return std::string();
+		}
+		hashBytes(hash, &fileSize, sizeof(fileSize));
+		hashBytes(hash, &writeTime, sizeof(writeTime));
+	}
+	hashBytes(hash, &format, sizeof(format));
+	hashBytes(hash, &COMPRESSED_TEXTURE_VERSION, sizeof(COMPRESSED_TEXTURE_VERSION));
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.dds", static_cast<unsigned long long>(hash));
+	return std::string(CACHE_DIR) + "/textures/" + name;
+}
+
+bool TextureCompressor::loadOrCompress(const std::string& path, BlockFormat format, CompressedImage& image)
+{
+	std::string cache = cachePath({ path }, format);
+	if (!cache.empty() && readDDS(cache, image) && image.format == format) {
+		return true;
+	}
+
+	// Cached images are stored bottom row first, like the uncompressed uploads.
+	// The flip flag is global in stb_image, so set the copy of the calling thread.
+	stbi_set_flip_vertically_on_load_thread(true);
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+	if (!pixels) {
+		return false;
+	}
+	compress(pixels, width, height, format, image);
+	stbi_image_free(pixels);
+
+	if (!cache.empty()) {
+		writeDDS(cache, image);
+	}
+	return true;
+}
+
+bool TextureCompressor::loadOrPack(const std::vector<std::string>& channelPaths, BlockFormat format, CompressedImage& image)
+{
+	std::string cache = cachePath(channelPaths, format);
+	if (!cache.empty() && readDDS(cache, image) && image.format == format) {
+		return true;
+	}
+
+	struct Channel {
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+	};
+	std::vector<Channel> channels(channelPaths.size());
+
+	stbi_set_flip_vertically_on_load_thread(true);
+	int width = 0, height = 0;
+	for (size_t i = 0; i < channelPaths.size(); ++i) {
+		if (channelPaths[i].empty()) {
+			continue;
+		}
+		int sourceChannels;
+		channels[i].pixels = stbi_load(channelPaths[i].c_str(), &channels[i].width, &channels[i].height, &sourceChannels, 1);
+		if (!channels[i].pixels) {
+			std::cout << "Failed to load texture: " << channelPaths[i] << std::endl;
+			continue;
+		}
+		if (channels[i].width * channels[i].height > width * height) {
+			width = channels[i].width;
+			height = channels[i].height;
+		}
+	}
+
+	bool loaded = width > 0;
+	if (loaded) {
+		std::vector<unsigned char> packed(static_cast<size_t>(width) * height * 4, 255);
+		for (size_t i = 0; i < channels.size() && i < 4; ++i) {
+			const Channel& channel = channels[i];
+			if (!channel.pixels) {
+				continue;
+			}
+			// Nearest sampling when the sources do not share a resolution
+			for (int y = 0; y < height; ++y) {
+				int sy = y * channel.height / height;
+				for (int x = 0; x < width; ++x) {
+					int sx = x * channel.width / width;
+					packed[(static_cast<size_t>(y) * width + x) * 4 + i] = channel.pixels[static_cast<size_t>(sy) * channel.width + sx];
+				}
+			}
+		}
+		compress(packed.data(), width, height, format, image);
+	}
+
+	for (Channel& channel : channels) {
+		stbi_image_free(channel.pixels);
+	}
+
+	if (loaded && !cache.empty()) {
+		writeDDS(cache, image);
+	}
+	return loaded;
+}
+
+void TextureCompressor::compress(const unsigned char* rgba, int width, int height, BlockFormat format, CompressedImage& image)
+{
+	image.format = format;
+	image.width = width;
+	image.height = height;
+
+	int levelCount = 1;
+	while ((width >> levelCount) > 0 || (height >> levelCount) > 0) {
+		levelCount++;
+	}
+	computeLevelOffsets(image, levelCount);
+	image.data.resize(image.levelOffsets.back());
+
+	std::vector<unsigned char> level(rgba, rgba + static_cast<size_t>(width) * height * 4);
+	std::vector<unsigned char> next;
+	for (int i = 0; i < levelCount; ++i) {
+		int levelWidth = image.getLevelWidth(i);
+		int levelHeight = image.getLevelHeight(i);
+		encodeLevel(level.data(), levelWidth, levelHeight, format, image.data.data() + image.levelOffsets[i]);
+
+		if (i + 1 < levelCount) {
+			downsample(level, levelWidth, levelHeight, format, next);
+			level.swap(next);
+		}
+	}
+}
+
+void TextureCompressor::encodeBC4Block(const unsigned char* block, unsigned char* out)
+{
+	encodeBC4Channel(block, 0, out);
+}
+
+void TextureCompressor::encodeBC5Block(const unsigned char* block, unsigned char* out)
+{
+	encodeBC4Channel(block, 0, out);
+	encodeBC4Channel(block, 1, out + 8);
+}
+
+void TextureCompressor::encodeBC7Block(const unsigned char* block, unsigned char* out)
+{
+	// Mode 6 only: one subset, RGBA endpoints and 4-bit indices
+	float mean[4] = {};
+	for (int p = 0; p < 16; ++p) {
+		for (int c = 0; c < 4; ++c) {
+			mean[c] += block[p * 4 + c] / 16.0f;
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int p = 0; p < 16; ++p) {
+		float d[4];
+		for (int c = 0; c < 4; ++c) {
+			d[c] = block[p * 4 + c] - mean[c];
+		}
+		for (int i = 0; i < 4; ++i) {
+			for (int j = 0; j < 4; ++j) {
+				covariance[i][j] += d[i] * d[j];
+			}
+		}
+	}
+
+	// Principal axis by power iteration
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = {};
+		for (int i = 0; i < 4; ++i) {
+			for (int j = 0; j < 4; ++j) {
+				next[i] += covariance[i][j] * axis[j];
+			}
+		}
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f) {
+			break;
+		}
+		for (int c = 0; c < 4; ++c) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float minT = 0.0f, maxT = 0.0f;
+	for (int p = 0; p < 16; ++p) {
+		float t = 0.0f;
+		for (int c = 0; c < 4; ++c) {
+			t += (block[p * 4 + c] - mean[c]) * axis[c];
+		}
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	float endpoints[2][4];
+	for (int c = 0; c < 4; ++c) {
+		endpoints[0][c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+		endpoints[1][c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+	}
+
+	int quantized[2][4];
+	int indices[16];
+	quantizeEndpoint(endpoints[0], quantized[0]);
+	quantizeEndpoint(endpoints[1], quantized[1]);
+	int error = selectIndices(block, quantized[0], quantized[1], indices);
+
+	// Refit the endpoints to the chosen indices and keep the result when it is better
+	for (int iteration = 0; iteration < 2 && error > 0; ++iteration) {
+		if (!fitEndpoints(block, indices, endpoints[0], endpoints[1])) {
+			break;
+		}
+		int candidate[2][4];
+		int candidateIndices[16];
+		quantizeEndpoint(endpoints[0], candidate[0]);
+		quantizeEndpoint(endpoints[1], candidate[1]);
+		int candidateError = selectIndices(block, candidate[0], candidate[1], candidateIndices);
+		if (candidateError >= error) {
+			break;
+		}
+		error = candidateError;
+		std::memcpy(quantized, candidate, sizeof(quantized));
+		std::memcpy(indices, candidateIndices, sizeof(indices));
+	}
+
+	// The first index is stored without its top bit, swap the endpoints when it is set
+	if (indices[0] & 8) {
+		for (int c = 0; c < 4; ++c) {
+			std::swap(quantized[0][c], quantized[1][c]);
+		}
+		for (int p = 0; p < 16; ++p) {
+			indices[p] = 15 - indices[p];
+		}
+	}
+
+	BitWriter writer(out);
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c) {
+		writer.write(quantized[0][c] >> 1, 7);
+		writer.write(quantized[1][c] >> 1, 7);
+	}
+	writer.write(quantized[0][0] & 1, 1);
+	writer.write(quantized[1][0] & 1, 1);
+	writer.write(indices[0], 3);
+	for (int p = 1; p < 16; ++p) {
+		writer.write(indices[p], 4);
+	}
+}
+
+bool TextureCompressor::readDDS(const std::string& path, CompressedImage& image)
+{
+	MappedFile file;
+	const size_t headerSize = sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+	if (!file.open(path) || file.size() < headerSize) {
+		return false;
+	}
+
+	uint32_t magic;
+	DDSHeader header;
+	DDSHeaderDX10 headerDX10;
+	std::memcpy(&magic, file.data(), sizeof(magic));
+	std::memcpy(&header, file.data() + sizeof(magic), sizeof(header));
+	std::memcpy(&headerDX10, file.data() + sizeof(magic) + sizeof(header), sizeof(headerDX10));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.pixelFormat.fourCC != DDS_FOURCC_DX10 ||
+		header.width == 0 || header.height == 0 || header.mipMapCount == 0) {
+		return false;
+	}
+
+	if (headerDX10.dxgiFormat == DXGI_FORMAT_BC4_UNORM) {
+		image.format = BlockFormat::BC4;
+	}
+	else if (headerDX10.dxgiFormat == DXGI_FORMAT_BC5_UNORM) {
+		image.format = BlockFormat::BC5;
+	}
+	else if (headerDX10.dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB) {
+		image.format = BlockFormat::BC7_SRGB;
+	}
+	else if (headerDX10.dxgiFormat == DXGI_FORMAT_BC7_UNORM) {
+		image.format = BlockFormat::BC7;
+	}
+	else {
+		return false;
+	}
+
+	// A corrupt or stale entry must not drive the level shifts or sizes past the mapping
+	if (header.width > MAX_DDS_SIZE || header.height > MAX_DDS_SIZE) {
+		return false;
+	}
+	uint32_t maxLevelCount = 1;
+	while ((std::max(header.width, header.height) >> maxLevelCount) > 0) {
+		maxLevelCount++;
+	}
+	if (header.mipMapCount > maxLevelCount) {
+		return false;
+	}
+
+	image.width = static_cast<int>(header.width);
+	image.height = static_cast<int>(header.height);
+	computeLevelOffsets(image, static_cast<int>(header.mipMapCount));
+	// The levels must fill the mapping exactly, the data is copied from it as one block
+	if (file.size() != headerSize + image.levelOffsets.back()) {
+		return false;
+	}
+
+	image.data.assign(file.data() + headerSize, file.data() + file.size());
+	return true;
+}
+
+bool TextureCompressor::writeDDS(const std::string& path, const CompressedImage& image)
+{
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+	header.height = static_cast<uint32_t>(image.height);
+	header.width = static_cast<uint32_t>(image.width);
+	header.pitchOrLinearSize = static_cast<uint32_t>(image.getLevelSize(0));
+	header.mipMapCount = static_cast<uint32_t>(image.getLevelCount());
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = 0x4; // fourCC
+	header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+	header.caps[0] = 0x1000 | 0x400000 | 0x8; // texture, mipmap, complex
+
+	DDSHeaderDX10 headerDX10 = {};
+	headerDX10.dxgiFormat = toDXGIFormat(image.format);
+	headerDX10.resourceDimension = 3; // texture 2D
+	headerDX10.arraySize = 1;
+
+	return writeFileAtomic(path, {
+		{ &DDS_MAGIC, sizeof(DDS_MAGIC) },
+		{ &header, sizeof(header) },
+		{ &headerDX10, sizeof(headerDX10) },
+		{ image.data.data(), image.data.size() },
+	});
+}
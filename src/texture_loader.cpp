@@ -0,0 +1,164 @@
+#include "texture_loader.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// Neutral values for each TextureType: grey albedo, flat normal, dielectric, mid roughness, no occlusion
+	const unsigned char PLACEHOLDER_PIXELS[6][4] = {
+		{ 188, 188, 188, 255 },
+		{ 128, 128, 255, 255 },
+		{ 0, 0, 0, 255 },
+		{ 128, 128, 128, 255 },
+		{ 255, 255, 255, 255 },
+		{ 255, 128, 0, 255 },
+	};
+}
+
+TextureLoader& TextureLoader::get()
+{
+	static TextureLoader loader;
+	return loader;
+}
+
+TextureLoader::TextureLoader()
+{
+	// Leave one core to the GL thread
+	unsigned int coreCount = std::thread::hardware_concurrency();
+	unsigned int workerCount = coreCount > 1 ? coreCount - 1 : 1;
+	for (unsigned int i = 0; i < workerCount; ++i) {
+		m_workers.emplace_back(&TextureLoader::workerLoop, this);
+	}
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		m_stopping = true;
+	}
+	m_jobCondition.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+
+}
+
+void TextureLoader::request(const std::shared_ptr<TextureRequest>& request)
+{
+	m_pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		m_jobs.push_back(request);
+	}
+	m_jobCondition.notify_one();
+}
+
+void TextureLoader::workerLoop()
+{
+	while (true) {
+		std::shared_ptr<TextureRequest> request;
+		{
+			std::unique_lock<std::mutex> lock(m_jobMutex);
+			m_jobCondition.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+			if (m_stopping) {
+				return;
+			}
+			request = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		DecodedImage decoded;
+		decoded.request = request;
+		if (!request->cancelled.load(std::memory_order_relaxed)) {
+			BlockFormat format = TextureCompressor::formatFor(request->type);
+			if (request->channelPaths.empty()) {
+				TextureCompressor::loadOrCompress(request->path, format, decoded.image);
+			}
+			else {
+				TextureCompressor::loadOrPack(request->channelPaths, format, decoded.image);
+			}
+		}
+		m_decoded.push(std::move(decoded));
+	}
+}
+
+void TextureLoader::update()
+{
+	size_t uploaded = 0;
+	DecodedImage decoded;
+	while (uploaded < m_uploadBudget && m_decoded.pop(decoded)) {
+		if (!decoded.request->cancelled.load(std::memory_order_relaxed)) {
+			upload(decoded);
+			uploaded += decoded.image.data.size();
+		}
+		decoded = DecodedImage();
+		m_pending.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+void TextureLoader::upload(const DecodedImage& decoded)
+{
+	TextureRequest& request = *decoded.request;
+	const CompressedImage& image = decoded.image;
+
+	if (image.getLevelCount() == 0) {
+		std::cout << "Failed to load texture: " << request.path << std::endl;
+		request.state = TextureState::Failed;
+		return;
+	}
+
+	size_t size = image.data.size();
+	if (m_pbo == 0) {
+		glGenBuffers(1, &m_pbo);
+	}
+	m_pboCapacity = std::max(m_pboCapacity, size);
+
+	// Orphan the previous upload's storage so the copy never waits on it
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, m_pboCapacity, nullptr, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	uintptr_t source = 0;
+	if (mapped) {
+		std::memcpy(mapped, image.data.data(), size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else {
+		// Fall back to a client memory upload
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		source = reinterpret_cast<uintptr_t>(image.data.data());
+	}
+
+	// Every mip level comes from the file, nothing is generated at runtime
+	const GLenum format = TextureCompressor::getGLFormat(image.format);
+	glBindTexture(GL_TEXTURE_2D, request.texture);
+	for (int level = 0; level < image.getLevelCount(); ++level) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, image.getLevelWidth(level), image.getLevelHeight(level), 0,
+			static_cast<GLsizei>(image.getLevelSize(level)), reinterpret_cast<const void*>(source + image.levelOffsets[level]));
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.getLevelCount() - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	request.state = TextureState::Ready;
+	request.gpuBytes = size;
+	std::cout << "Loaded texture: " << request.path << " (" << image.width << "x" << image.height << ", "
+		<< TextureCompressor::getFormatName(image.format) << ", " << image.getLevelCount() << " levels, "
+		<< size / 1024 << " KB)" << std::endl;
+}
+
+unsigned int TextureLoader::getPlaceholder(TextureType type)
+{
+	unsigned int& placeholder = m_placeholders[static_cast<int>(type)];
+	if (placeholder == 0) {
+		glGenTextures(1, &placeholder);
+		glBindTexture(GL_TEXTURE_2D, placeholder);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, type == TextureType::ALBEDO ? GL_SRGB8_ALPHA8 : GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			PLACEHOLDER_PIXELS[static_cast<int>(type)]);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	return placeholder;
+}
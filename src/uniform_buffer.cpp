@@ -0,0 +1,47 @@
+#include "uniform_buffer.h"
+#include "glad/glad.h"
+
+UniformBuffer::UniformBuffer(size_t size, unsigned int binding) : m_binding(binding)
+{
+	glGenBuffers(1, &m_ubo);
+	resize(size);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers(1, &m_ubo);
+}
+
+void UniformBuffer::update(const void* data, size_t size, size_t offset)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::resize(size_t size)
+{
+	m_size = size;
+	glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind() const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, m_binding, m_ubo);
+}
+
+void UniformBuffer::bindRange(size_t offset, size_t size) const
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, m_binding, m_ubo, offset, size);
+}
+
+size_t UniformBuffer::getOffsetAlignment()
+{
+	static GLint alignment = 0;
+	if (alignment == 0) {
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	}
+	return static_cast<size_t>(alignment);
+}
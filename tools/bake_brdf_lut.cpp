@@ -0,0 +1,23 @@
+// Offline generator of res/textures/brdf_lut.rg16f, built with -DBUILD_TOOLS=ON
+#include "brdf_lut.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv)
+{
+	std::string path = argc > 1 ? argv[1] : "brdf_lut.rg16f";
+	int size = argc > 2 ? std::atoi(argv[2]) : BrdfLut::DEFAULT_SIZE;
+	int sampleCount = argc > 3 ? std::atoi(argv[3]) : BrdfLut::DEFAULT_SAMPLE_COUNT;
+	if (size <= 0 || sampleCount <= 0) {
+		std::cerr << "Usage: bake_brdf_lut [output] [size] [samples]" << std::endl;
+		return 1;
+	}
+
+	std::vector<float> table = BrdfLut::compute(size, sampleCount);
+	if (!BrdfLut::write(path, size, sampleCount, table)) {
+		return 1;
+	}
+	std::cout << "Wrote " << size << "x" << size << " BRDF LUT with " << sampleCount << " samples to " << path << std::endl;
+	return 0;
+}
@@ -0,0 +1,223 @@
+// CPU benchmark of the scene BVH against linear scans, built with -DBUILD_BENCHMARKS=ON
+#include "bvh.h"
+#include "frustum.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	const int FRUSTUM_REPEATS = 20;
+	const int RAY_COUNT = 1000;
+	const int BOX_QUERY_COUNT = 1000;
+
+	double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Boxes of 0.5 to 2 units at one per 64 cubic units, so every size sees the same local clutter
+	std::vector<AABB> makeBoxes(size_t count, float worldSize, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> position(0.0f, worldSize);
+		std::uniform_real_distribution<float> halfSize(0.25f, 1.0f);
+		std::vector<AABB> boxes(count);
+		for (AABB& box : boxes) {
+			glm::vec3 center(position(rng), position(rng), position(rng));
+			glm::vec3 extent(halfSize(rng), halfSize(rng), halfSize(rng));
+			box = { center - extent, center + extent };
+		}
+		return boxes;
+	}
+
+	bool intersectRay(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float& entry)
+	{
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 entries = glm::min(t0, t1);
+		glm::vec3 exits = glm::max(t0, t1);
+		entry = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+		return entry <= std::min(std::min(exits.x, exits.y), exits.z);
+	}
+
+	bool overlaps(const AABB& a, const AABB& b)
+	{
+		return a.min.x <= b.max.x && a.max.x >= b.min.x
+			&& a.min.y <= b.max.y && a.max.y >= b.min.y
+			&& a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+
+	void printRow(const char* label, double milliseconds, const std::string& note = "")
+	{
+		std::cout << "  " << std::left << std::setw(28) << label << std::right << std::setw(12) << std::fixed
+			<< std::setprecision(3) << milliseconds << " ms" << (note.empty() ? "" : "  " + note) << std::endl;
+	}
+
+	void run(size_t count, std::mt19937& rng)
+	{
+		float worldSize = std::cbrt(static_cast<float>(count) * 64.0f);
+		std::vector<AABB> boxes = makeBoxes(count, worldSize, rng);
+		std::vector<uint32_t> items(count);
+		for (size_t i = 0; i < count; ++i) {
+			items[i] = static_cast<uint32_t>(i);
+		}
+		std::cout << count << " boxes in a " << worldSize << " unit cube" << std::endl;
+
+		Bvh bvh;
+		std::vector<int32_t> proxies;
+		Clock::time_point start = Clock::now();
+		bvh.build(boxes, items, proxies);
+		printRow("SAH build", millisecondsSince(start), "cost " + std::to_string(bvh.getCost()) + ", height " + std::to_string(bvh.getHeight()));
+
+		{
+			Bvh inserted;
+			start = Clock::now();
+			for (size_t i = 0; i < count; ++i) {
+				inserted.insert(boxes[i], items[i]);
+			}
+			printRow("Incremental inserts", millisecondsSince(start), "cost " + std::to_string(inserted.getCost()) + ", height " + std::to_string(inserted.getHeight()));
+		}
+
+		// Every tenth box moves by up to a unit, as a busy frame would
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+		start = Clock::now();
+		for (size_t i = 0; i < count; i += 10) {
+			glm::vec3 delta(offset(rng), offset(rng), offset(rng));
+			boxes[i] = { boxes[i].min + delta, boxes[i].max + delta };
+			bvh.setLeafBounds(proxies[i], boxes[i]);
+		}
+		bvh.refit();
+		printRow("Move 10% and refit", millisecondsSince(start), "cost " + std::to_string(bvh.getCost()));
+
+		start = Clock::now();
+		for (size_t i = 5; i < count; i += 1000) {
+			glm::vec3 delta(offset(rng), offset(rng), offset(rng));
+			boxes[i] = { boxes[i].min + delta, boxes[i].max + delta };
+			bvh.update(proxies[i], boxes[i]);
+		}
+		printRow("Move 0.1% one by one", millisecondsSince(start));
+
+		start = Clock::now();
+		for (size_t i = 3; i < count; i += 100) {
+			bvh.remove(proxies[i]);
+			proxies[i] = bvh.insert(boxes[i], items[i]);
+		}
+		printRow("Remove and insert 1%", millisecondsSince(start));
+
+		// Camera on the edge of the cube looking at its center, far plane at the opposite side
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, worldSize);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, worldSize * 0.5f, 0.0f), glm::vec3(worldSize * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum(projection * view);
+
+		std::vector<uint8_t> visible;
+		size_t linearVisible = 0;
+		start = Clock::now();
+		for (int i = 0; i < FRUSTUM_REPEATS; ++i) {
+			linearVisible = frustum.cull(boxes, visible);
+		}
+		printRow("Frustum, linear SIMD", millisecondsSince(start) / FRUSTUM_REPEATS, std::to_string(linearVisible) + " visible");
+
+		std::vector<uint32_t> found;
+		start = Clock::now();
+		for (int i = 0; i < FRUSTUM_REPEATS; ++i) {
+			found.clear();
+			bvh.queryFrustum(frustum, found);
+		}
+		size_t mismatches = found.size() != linearVisible;
+		for (uint32_t item : found) {
+			mismatches += visible[item] == 0;
+		}
+		printRow("Frustum, BVH", millisecondsSince(start) / FRUSTUM_REPEATS,
+			std::to_string(found.size()) + " visible, " + std::to_string(mismatches) + " mismatches");
+
+		// Rays from random points towards random directions across the cube
+		std::uniform_real_distribution<float> position(0.0f, worldSize);
+		std::vector<glm::vec3> origins(RAY_COUNT), directions(RAY_COUNT);
+		for (int i = 0; i < RAY_COUNT; ++i) {
+			origins[i] = glm::vec3(position(rng), position(rng), position(rng));
+			directions[i] = glm::normalize(glm::vec3(position(rng), position(rng), position(rng)) - origins[i] + glm::vec3(0.001f));
+		}
+
+		std::vector<float> linearDistances(RAY_COUNT, -1.0f);
+		start = Clock::now();
+		for (int r = 0; r < RAY_COUNT; ++r) {
+			glm::vec3 inverseDirection = 1.0f / directions[r];
+			for (const AABB& box : boxes) {
+				float entry;
+				if (intersectRay(box, origins[r], inverseDirection, entry) && (linearDistances[r] < 0.0f || entry < linearDistances[r])) {
+					linearDistances[r] = entry;
+				}
+			}
+		}
+		printRow("Rays, linear", millisecondsSince(start), std::to_string(RAY_COUNT) + " rays");
+
+		mismatches = 0;
+		start = Clock::now();
+		for (int r = 0; r < RAY_COUNT; ++r) {
+			uint32_t item;
+			float distance = -1.0f;
+			if (!bvh.raycast(origins[r], directions[r], worldSize * 2.0f, item, distance)) {
+				distance = -1.0f;
+			}
+			// Distances beyond the query range count as misses for both
+			float expected = linearDistances[r] > worldSize * 2.0f ? -1.0f : linearDistances[r];
+			mismatches += std::abs(distance - expected) > 1e-3f;
+		}
+		printRow("Rays, BVH", millisecondsSince(start), std::to_string(mismatches) + " mismatches");
+
+		std::vector<AABB> queries = makeBoxes(BOX_QUERY_COUNT, worldSize, rng);
+		for (AABB& query : queries) {
+			query.min -= glm::vec3(2.0f);
+			query.max += glm::vec3(2.0f);
+		}
+		size_t linearHits = 0;
+		start = Clock::now();
+		for (const AABB& query : queries) {
+			for (const AABB& box : boxes) {
+				linearHits += overlaps(query, box);
+			}
+		}
+		printRow("Box queries, linear", millisecondsSince(start), std::to_string(linearHits) + " hits");
+
+		size_t bvhHits = 0;
+		start = Clock::now();
+		for (const AABB& query : queries) {
+			found.clear();
+			bvh.queryBox(query, found);
+			bvhHits += found.size();
+		}
+		printRow("Box queries, BVH", millisecondsSince(start), std::to_string(bvhHits) + " hits");
+		std::cout << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<size_t> counts;
+	for (int i = 1; i < argc; ++i) {
+		long long count = std::atoll(argv[i]);
+		if (count <= 0) {
+			std::cerr << "Usage: bench_bvh [entity counts...]" << std::endl;
+			return 1;
+		}
+		counts.push_back(static_cast<size_t>(count));
+	}
+	if (counts.empty()) {
+		counts = { 10000, 100000, 1000000 };
+	}
+
+	// Fixed seed so runs compare
+	std::mt19937 rng(1234);
+	for (size_t count : counts) {
+		run(count, rng);
+	}
+	return 0;
+}